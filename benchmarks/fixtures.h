@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <memory>
+#include "security.h"
+#include "snapshot.h"
+#include "channel.h"
+#include "bot.h"
+#include "panes.h"
+
+namespace Bench
+{
+	// the probes only widen access so the benchmarks can reach the protected hot paths directly
+
+	class ChannelProbe : public Channel
+	{
+	public:
+		using Channel::Channel;
+		using Channel::ParseMessage;
+	};
+
+	class BotProbe : public Bot
+	{
+	public:
+		using Bot::Bot;
+		using Bot::DispatchCommand;
+		static void BadgeIconURL(const QString &badge,const QString &version,const QString &url) { badgeIconURLs[badge][version]=url; }
+	};
+
+	class ChatPaneProbe : public ChatPane
+	{
+	public:
+		using ChatPane::ChatPane;
+		void Flush() { chat->Flush(); }
+	};
+
+	class AnnouncePaneProbe : public AnnouncePane
+	{
+	public:
+		using AnnouncePane::AnnouncePane;
+		using AnnouncePane::BuildParagraph;
+	};
+
+	// built the first time a benchmark needs it, then shared by the rest of the run
+	struct Environment
+	{
+		Environment();
+		Security security;
+		Snapshot snapshot;
+		Presence presence;
+		Music::Player musicPlayer;
+		std::unique_ptr<BotProbe> bot;
+	};
+
+	Environment& Shared();
+
+	// places a file where the code under test expects to find one, so nothing falls through to the network
+	QString Plant(const QString &path,const QByteArray &data=QByteArray());
+
+	// tears the environment down while the application still exists and removes any planted files that weren't there before the run
+	void Release();
+}
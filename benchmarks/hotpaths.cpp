@@ -0,0 +1,344 @@
+#include <QTemporaryDir>
+#include <QImage>
+#include <QBuffer>
+#include <QFontMetrics>
+#include <QtEndian>
+#include <benchmark/benchmark.h>
+#include "fixtures.h"
+#include "typesetting.h"
+#include "utf8.h"
+
+const char *BENCH_LOGIN="celeste";
+const char *BENCH_SOURCE="celeste!celeste@celeste.tmi.twitch.tv";
+const char *BENCH_TAGS_PLAIN="badge-info=;badges=;color=#8A2BE2;display-name=Celeste;emotes=;id=b34ccfc7-4977-403a-8a94-33c6bac34fb8;mod=0;room-id=1;subscriber=0;tmi-sent-ts=1700000000000;turbo=0;user-id=1;user-type=";
+const char *BENCH_TAGS_BADGES="badge-info=subscriber/12;badges=broadcaster/1,subscriber/12,premium/1;color=#8A2BE2;display-name=Celeste;emotes=;id=b34ccfc7-4977-403a-8a94-33c6bac34fb8;mod=0;room-id=1;subscriber=1;tmi-sent-ts=1700000000000;turbo=0;user-id=1;user-type=";
+const char *BENCH_TAGS_EMOTES="badge-info=subscriber/12;badges=broadcaster/1,subscriber/12;color=#8A2BE2;display-name=Celeste;emotes=25:0-4,27-31/88:12-19;id=b34ccfc7-4977-403a-8a94-33c6bac34fb8;mod=0;room-id=1;subscriber=1;tmi-sent-ts=1700000000000;turbo=0;user-id=1;user-type=";
+const char *BENCH_TAGS_EMOJI_EMOTES="badge-info=subscriber/12;badges=broadcaster/1,subscriber/12;color=#8A2BE2;display-name=Celeste;emotes=25:3-7,22-26/88:11-18;id=b34ccfc7-4977-403a-8a94-33c6bac34fb8;mod=0;room-id=1;subscriber=1;tmi-sent-ts=1700000000000;turbo=0;user-id=1;user-type=";
+const char *BENCH_MESSAGE_PLAIN="just checking in to see how the stream is going today";
+const char *BENCH_MESSAGE_EMOTES="Kappa hello PogChamp world Kappa";
+const char *BENCH_MESSAGE_EMOJI_EMOTES="\xF0\x9F\x98\x82\xF0\x9F\x98\x82 Kappa \xF0\x9F\x94\xA5 PogChamp \xF0\x9F\x94\xA5 Kappa"; // emote positions count each emoji once, the way Twitch does
+const char *BENCH_MESSAGE_EMOJI="\xF0\x9F\x98\x82\xF0\x9F\x98\x82 no way \xF0\x9F\x94\xA5\xF0\x9F\x94\xA5\xF0\x9F\x94\xA5 caf\xC3\xA9 run \xE2\x9D\xA4\xEF\xB8\x8F \xF0\x9F\x91\x8F\xF0\x9F\x8F\xBD\xF0\x9F\x91\x8F\xF0\x9F\x8F\xBD GG \xE3\x81\x82\xE3\x82\x8A\xE3\x81\x8C\xE3\x81\xA8\xE3\x81\x86";
+const int BENCH_INGRESS_LINES=256;
+const int BENCH_CHAT_PANE_RESET=1000;
+const int BENCH_CHAT_BURST=100;
+const int BENCH_FIT_WIDTH_SPREAD=2048; // more widths than the fit cache holds entries, so every layout misses it
+
+namespace Bench
+{
+	static void PlantChatImages()
+	{
+		static bool planted=false;
+		if (planted) return;
+		BotProbe::BadgeIconURL(u"broadcaster"_s,u"1"_s,u"https://static-cdn.jtvnw.net/badges/v1/broadcaster/1"_s);
+		BotProbe::BadgeIconURL(u"subscriber"_s,u"12"_s,u"https://static-cdn.jtvnw.net/badges/v1/subscriber/12"_s);
+		for (const QString &name : {u"broadcaster_1.png"_s,u"subscriber_12.png"_s,u"25.png"_s,u"88.png"_s}) Plant(Filesystem::TemporaryPath().filePath(name));
+		planted=true;
+	}
+
+	static QByteArray SyncSafe(quint32 value)
+	{
+		QByteArray result(4,'\0');
+		for (int index=3; index >= 0; index--)
+		{
+			result[index]=static_cast<char>(value & 0x7F);
+			value >>= 7;
+		}
+		return result;
+	}
+
+	static QByteArray ID3Frame(const char *id,const QByteArray &body)
+	{
+		return QByteArray(id,4)+SyncSafe(body.size())+QByteArray(2,'\0')+body;
+	}
+
+	static QByteArray ID3TextFrame(const char *id,const QString &text)
+	{
+		return ID3Frame(id,QByteArray(1,'\0')+text.toLatin1()+QByteArray(1,'\0'));
+	}
+
+	// a tag like the ones the vibe keeper reads on every track change, with cover art large enough to need scaling
+	static QByteArray ID3File()
+	{
+		QImage cover(512,512,QImage::Format_RGB32);
+		for (int y=0; y < cover.height(); y++)
+		{
+			for (int x=0; x < cover.width(); x++) cover.setPixel(x,y,qRgb(x/2,y/2,(x+y)/4));
+		}
+		QByteArray png;
+		QBuffer buffer(&png);
+		buffer.open(QIODevice::WriteOnly);
+		cover.save(&buffer,"PNG");
+
+		const QByteArray frames=ID3TextFrame("TIT2",u"Starlight Drive"_s)
+			+ID3TextFrame("TALB",u"Night Shift"_s)
+			+ID3TextFrame("TPE1",u"Engineering Deck"_s)
+			+ID3Frame("APIC",QByteArray(1,'\0')+QByteArray("image/png",10)+QByteArray(1,3)+QByteArray(1,'\0')+png);
+		QByteArray header("ID3\x03\x00\x00",6);
+		QByteArray size(4,'\0');
+		qToBigEndian<quint32>(frames.size(),size.data()); // sized the way ID3::Header::ParseSize reads it
+		return header+size+frames+QByteArray(4096,'\xFF');
+	}
+
+	// raw lines the way they come off the socket, tags and all, so the mix of ASCII and everything else is realistic
+	static std::vector<QByteArray> IngressLines(const char *message)
+	{
+		std::vector<QByteArray> lines;
+		for (int index=0; index < BENCH_INGRESS_LINES; index++) lines.push_back(QByteArray("@")+BENCH_TAGS_BADGES+" :"+BENCH_SOURCE+" PRIVMSG #"+BENCH_LOGIN+" :"+message+" "+QByteArray::number(index)+"\r\n");
+		return lines;
+	}
+
+	static qint64 Size(const std::vector<QByteArray> &lines)
+	{
+		qint64 size=0;
+		for (const QByteArray &line : lines) size+=line.size();
+		return size;
+	}
+
+	static QStringList Filenames(int count)
+	{
+		QStringList result;
+		for (int index=0; index < count; index++) result.append(u"/videos/clip-%1.mp4"_s.arg(index));
+		return result;
+	}
+}
+
+static void BM_ChannelParseMessage(benchmark::State &state,const char *tags,const char *message)
+{
+	Bench::ChannelProbe channel(Bench::Shared().security);
+	const QString line=u"@%1 :%2 PRIVMSG #%3 :%4"_s.arg(tags,BENCH_SOURCE,BENCH_LOGIN,message);
+	for (auto _ : state) channel.ParseMessage(line);
+}
+BENCHMARK_CAPTURE(BM_ChannelParseMessage,plain,BENCH_TAGS_PLAIN,BENCH_MESSAGE_PLAIN);
+BENCHMARK_CAPTURE(BM_ChannelParseMessage,emotes,BENCH_TAGS_EMOTES,BENCH_MESSAGE_EMOTES);
+
+static void BM_UTF8Valid(benchmark::State &state,const char *message)
+{
+	const std::vector<QByteArray> lines=Bench::IngressLines(message);
+	for (auto _ : state)
+	{
+		for (const QByteArray &line : lines) benchmark::DoNotOptimize(UTF8::Valid(line));
+	}
+	state.SetBytesProcessed(state.iterations()*Bench::Size(lines));
+	state.SetLabel(UTF8::Kernel());
+}
+BENCHMARK_CAPTURE(BM_UTF8Valid,plain,BENCH_MESSAGE_PLAIN);
+BENCHMARK_CAPTURE(BM_UTF8Valid,emoji,BENCH_MESSAGE_EMOJI);
+
+static void BM_UTF8Decode(benchmark::State &state,const char *message)
+{
+	const std::vector<QByteArray> lines=Bench::IngressLines(message);
+	for (auto _ : state)
+	{
+		for (const QByteArray &line : lines) benchmark::DoNotOptimize(UTF8::Decode(line));
+	}
+	state.SetBytesProcessed(state.iterations()*Bench::Size(lines));
+	state.SetLabel(UTF8::Kernel());
+}
+BENCHMARK_CAPTURE(BM_UTF8Decode,plain,BENCH_MESSAGE_PLAIN);
+BENCHMARK_CAPTURE(BM_UTF8Decode,emoji,BENCH_MESSAGE_EMOJI);
+
+// what the socket path used to do, for comparison
+static void BM_QStringFromUtf8(benchmark::State &state,const char *message)
+{
+	const std::vector<QByteArray> lines=Bench::IngressLines(message);
+	for (auto _ : state)
+	{
+		for (const QByteArray &line : lines) benchmark::DoNotOptimize(QString::fromUtf8(line));
+	}
+	state.SetBytesProcessed(state.iterations()*Bench::Size(lines));
+}
+BENCHMARK_CAPTURE(BM_QStringFromUtf8,plain,BENCH_MESSAGE_PLAIN);
+BENCHMARK_CAPTURE(BM_QStringFromUtf8,emoji,BENCH_MESSAGE_EMOJI);
+
+static void BM_BotParseChatMessage(benchmark::State &state,const char *tags,const char *message)
+{
+	Bench::Environment &environment=Bench::Shared();
+	Bench::PlantChatImages();
+	const QString prefix(tags);
+	const QString source(BENCH_SOURCE);
+	const QStringList parameters({u"#%1"_s.arg(BENCH_LOGIN)});
+	const QString text(message);
+	for (auto _ : state) environment.bot->ParseChatMessage(prefix,source,parameters,text);
+}
+BENCHMARK_CAPTURE(BM_BotParseChatMessage,plain,BENCH_TAGS_BADGES,BENCH_MESSAGE_PLAIN);
+BENCHMARK_CAPTURE(BM_BotParseChatMessage,emotes,BENCH_TAGS_EMOTES,BENCH_MESSAGE_EMOTES);
+BENCHMARK_CAPTURE(BM_BotParseChatMessage,emoji_emotes,BENCH_TAGS_EMOJI_EMOTES,BENCH_MESSAGE_EMOJI_EMOTES);
+
+static void BM_BotDispatchCommand(benchmark::State &state,const char *name)
+{
+	Bench::Environment &environment=Bench::Shared();
+	const Chat::Message message{
+		.displayName=u"Celeste"_s,
+		.text=u"<b>bold</b> move"_s,
+		.color=QColor(0x8A,0x2B,0xE2),
+		.broadcaster=true
+	};
+	for (auto _ : state) benchmark::DoNotOptimize(environment.bot->DispatchCommand(name,message,BENCH_LOGIN));
+}
+BENCHMARK_CAPTURE(BM_BotDispatchCommand,html,"html");
+BENCHMARK_CAPTURE(BM_BotDispatchCommand,unknown,"notacommand");
+
+static void BM_ID3Tag(benchmark::State &state)
+{
+	QTemporaryDir directory;
+	const QString path=directory.filePath(u"track.mp3"_s);
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		state.SkipWithError("Failed to create mp3 file");
+		return;
+	}
+	file.write(Bench::ID3File());
+	file.close();
+
+	for (auto _ : state)
+	{
+		Music::ID3::Tag tag(path);
+		benchmark::DoNotOptimize(tag.Title());
+		benchmark::DoNotOptimize(tag.AlbumCoverFront());
+	}
+}
+BENCHMARK(BM_ID3Tag)->Unit(benchmark::kMicrosecond);
+
+static void BM_FileListRandom(benchmark::State &state)
+{
+	File::List list(Bench::Filenames(state.range(0)));
+	for (auto _ : state) benchmark::DoNotOptimize(list.Random());
+}
+BENCHMARK(BM_FileListRandom)->Arg(16)->Arg(1024);
+
+static void BM_FileListUnique(benchmark::State &state)
+{
+	File::List list(Bench::Filenames(state.range(0)));
+	for (auto _ : state) benchmark::DoNotOptimize(list.Unique());
+}
+BENCHMARK(BM_FileListUnique)->Arg(16)->Arg(1024);
+
+static void BM_FileListRandomIndex(benchmark::State &state)
+{
+	File::List list(Bench::Filenames(state.range(0)));
+	for (auto _ : state) benchmark::DoNotOptimize(list.RandomIndex());
+}
+BENCHMARK(BM_FileListRandomIndex)->Arg(16)->Arg(1024);
+
+static void BM_ChatPaneMessage(benchmark::State &state)
+{
+	Bench::PlantChatImages();
+	const Chat::Message message{
+		.displayName=u"Celeste"_s,
+		.text=BENCH_MESSAGE_EMOTES,
+		.color=QColor(0x8A,0x2B,0xE2),
+		.badges={Filesystem::TemporaryPath().filePath(u"broadcaster_1.png"_s),Filesystem::TemporaryPath().filePath(u"subscriber_12.png"_s)},
+		.emotes={
+			{.name=u"Kappa"_s,.id=u"25"_s,.path=Filesystem::TemporaryPath().filePath(u"25.png"_s),.start=0,.end=4},
+			{.name=u"PogChamp"_s,.id=u"88"_s,.path=Filesystem::TemporaryPath().filePath(u"88.png"_s),.start=12,.end=19},
+			{.name=u"Kappa"_s,.id=u"25"_s,.path=Filesystem::TemporaryPath().filePath(u"25.png"_s),.start=27,.end=31}
+		},
+		.html=state.range(0) != 0
+	};
+	state.SetLabel(message.html ? "html" : "fragment");
+
+	// the chat document only ever grows, so start a fresh pane now and then to keep each measurement comparable
+	// committing every message on its own is the worst case, a frame that only ever sees one message
+	std::unique_ptr<Bench::ChatPaneProbe> pane=std::make_unique<Bench::ChatPaneProbe>(nullptr);
+	int count=0;
+	for (auto _ : state)
+	{
+		pane->Message(message);
+		pane->Flush();
+		if (++count % BENCH_CHAT_PANE_RESET == 0)
+		{
+			state.PauseTiming();
+			pane=std::make_unique<Bench::ChatPaneProbe>(nullptr);
+			state.ResumeTiming();
+		}
+	}
+}
+BENCHMARK(BM_ChatPaneMessage)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond); // built with a text cursor, then through the HTML parser
+
+// a spike's worth of messages landing in one frame, committed together
+static void BM_ChatPaneBurst(benchmark::State &state)
+{
+	const Chat::Message message{
+		.displayName=u"Celeste"_s,
+		.text=BENCH_MESSAGE_PLAIN,
+		.color=QColor(0x8A,0x2B,0xE2)
+	};
+
+	std::unique_ptr<Bench::ChatPaneProbe> pane=std::make_unique<Bench::ChatPaneProbe>(nullptr);
+	int count=0;
+	for (auto _ : state)
+	{
+		for (int index=0; index < BENCH_CHAT_BURST; index++) pane->Message(message);
+		pane->Flush();
+		if (++count % (BENCH_CHAT_PANE_RESET/BENCH_CHAT_BURST) == 0)
+		{
+			state.PauseTiming();
+			pane=std::make_unique<Bench::ChatPaneProbe>(nullptr);
+			state.ResumeTiming();
+		}
+	}
+	state.SetItemsProcessed(state.iterations()*BENCH_CHAT_BURST);
+}
+BENCHMARK(BM_ChatPaneBurst)->Unit(benchmark::kMicrosecond);
+
+namespace Bench
+{
+	// the one-point-at-a-time search that FitPointSize replaced, kept here as the baseline
+	static int LinearPointSize(QFont font,const QString &text,int maxPixels)
+	{
+		int originalPointSize=font.pointSize();
+		QFontMetrics metrics{font};
+		QRect bounds=metrics.boundingRect(text);
+		while (bounds.width() > maxPixels)
+		{
+			int reducedPointSize=font.pointSize()-1;
+			if (reducedPointSize < 1) return originalPointSize;
+			font.setPointSize(reducedPointSize);
+			metrics=QFontMetrics{font};
+			bounds=metrics.boundingRect(text);
+		}
+		return font.pointSize();
+	}
+}
+
+// only lines without spaces get fitted, and the width moves every pass so the fit cache never answers
+static void BM_AnnouncePaneBuildParagraph(benchmark::State &state)
+{
+	Bench::AnnouncePaneProbe pane(Lines{
+		{u"xX_CelesteTheDeckhand_Xx"_s,1.5},
+		{u"FOLLOWED"_s,1.0},
+		{u"ThanksForStoppingBy"_s,0.75}
+	},nullptr);
+	const int width=state.range(0);
+	int offset=0;
+	for (auto _ : state) benchmark::DoNotOptimize(pane.BuildParagraph(width+(offset++ % BENCH_FIT_WIDTH_SPREAD)));
+}
+BENCHMARK(BM_AnnouncePaneBuildParagraph)->Arg(320)->Arg(1280)->Unit(benchmark::kMicrosecond);
+
+static void BM_FitPointSize(benchmark::State &state)
+{
+	const QFont font(u"Copperplate Gothic Bold"_s,30);
+	const QString text(u"xX_CelesteTheDeckhand_Xx"_s);
+	const int width=state.range(0);
+	for (auto _ : state) benchmark::DoNotOptimize(Typesetting::SearchPointSize(font,text,width));
+}
+BENCHMARK(BM_FitPointSize)->Arg(160)->Arg(320)->Arg(1280);
+
+static void BM_FitPointSizeLinear(benchmark::State &state)
+{
+	const QFont font(u"Copperplate Gothic Bold"_s,30);
+	const QString text(u"xX_CelesteTheDeckhand_Xx"_s);
+	const int width=state.range(0);
+	for (auto _ : state) benchmark::DoNotOptimize(Bench::LinearPointSize(font,text,width));
+}
+BENCHMARK(BM_FitPointSizeLinear)->Arg(160)->Arg(320)->Arg(1280);
+
+static void BM_FitPointSizeCached(benchmark::State &state)
+{
+	const QFont font(u"Copperplate Gothic Bold"_s,30);
+	const QString text(u"xX_CelesteTheDeckhand_Xx"_s);
+	const int width=state.range(0);
+	for (auto _ : state) benchmark::DoNotOptimize(Typesetting::FitPointSize(font,text,width));
+}
+BENCHMARK(BM_FitPointSizeCached)->Arg(160)->Arg(320)->Arg(1280);
@@ -0,0 +1,71 @@
+#include <QApplication>
+#include <QStandardPaths>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "fixtures.h"
+
+const char *ORGANIZATION_NAME="EngineeringDeck";
+const char *APPLICATION_NAME="Celeste";
+const char *DEFAULT_FORMAT="--benchmark_format=json";
+const quint64 BENCHMARK_SEED=0x43656c65737465; // every run shuffles and picks the same way, so runs compare like for like
+
+namespace Bench
+{
+	static QStringList planted;
+	static std::unique_ptr<Environment> environment;
+
+	Environment::Environment() : musicPlayer(false,0)
+	{
+		snapshot.Open();
+		bot=std::make_unique<BotProbe>(musicPlayer,security,snapshot,presence);
+	}
+
+	Environment& Shared()
+	{
+		if (!environment) environment=std::make_unique<Environment>();
+		return *environment;
+	}
+
+	QString Plant(const QString &path,const QByteArray &data)
+	{
+		QFile file(path);
+		if (file.exists()) return path;
+		if (!QDir().mkpath(QFileInfo(path).absolutePath()) || !file.open(QIODevice::WriteOnly)) throw std::runtime_error("Failed to create benchmark fixture: "+path.toStdString());
+		file.write(data);
+		planted.append(path);
+		return path;
+	}
+
+	void Release()
+	{
+		environment.reset();
+		for (const QString &path : planted) QFile::remove(path);
+		planted.clear();
+	}
+}
+
+int main(int argc,char *argv[])
+{
+	// nothing here should need a display, and settings and data go somewhere other than the real profile
+	if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM","offscreen");
+	QStandardPaths::setTestModeEnabled(true);
+
+	QApplication application(argc,argv);
+	application.setOrganizationName(ORGANIZATION_NAME);
+	application.setApplicationName(APPLICATION_NAME);
+	Random::Seed(BENCHMARK_SEED);
+
+	// JSON unless asked otherwise, so results can be diffed between commits; later arguments override earlier ones
+	std::vector<char*> arguments(argv,argv+argc);
+	arguments.insert(arguments.begin()+1,const_cast<char*>(DEFAULT_FORMAT));
+	int count=static_cast<int>(arguments.size());
+	benchmark::Initialize(&count,arguments.data());
+	if (benchmark::ReportUnrecognizedArguments(count,arguments.data())) return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	Bench::Release();
+	return 0;
+}
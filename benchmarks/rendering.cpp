@@ -0,0 +1,207 @@
+#include <QCoreApplication>
+#include <QImage>
+#include <QPainter>
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "fixtures.h"
+#include "window.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+const QSize BENCH_FRAME_SIZE(1280,720);
+const std::chrono::microseconds BENCH_FRAME_INTERVAL(16667); // 60 frames per second, like the stream
+const int BENCH_FRAMES=180;
+const int BENCH_CHAT_MESSAGE_INTERVAL=6; // in frames, so ten messages a second
+const int BENCH_COMMAND_COUNT=40;
+const char *BENCH_VIDEO_VARIABLE="CELESTE_BENCH_VIDEO";
+
+namespace Bench
+{
+	// a script gets called once before every frame, outside of the measurement, with the frame number
+	using Script=std::function<void(Window &window,int frame)>;
+
+	static double PeakResidentMegabytes()
+	{
+#ifdef Q_OS_WIN
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(),&counters,sizeof(counters))) return 0;
+		return static_cast<double>(counters.PeakWorkingSetSize)/1048576.0;
+#else
+		rusage usage;
+		if (getrusage(RUSAGE_SELF,&usage) != 0) return 0;
+#ifdef Q_OS_MACOS
+		return static_cast<double>(usage.ru_maxrss)/1048576.0; // bytes on macOS
+#else
+		return static_cast<double>(usage.ru_maxrss)/1024.0; // kilobytes everywhere else
+#endif
+#endif
+	}
+
+	static QImage Portrait(int size)
+	{
+		QImage image(size,size,QImage::Format_ARGB32_Premultiplied);
+		image.fill(Qt::transparent);
+		QPainter painter(&image);
+		painter.setRenderHint(QPainter::Antialiasing);
+		painter.setBrush(QColor(0x8A,0x2B,0xE2));
+		painter.drawEllipse(image.rect().adjusted(size/8,size/8,-size/8,-size/8));
+		return image;
+	}
+
+	static Chat::Message ChatLine(int index)
+	{
+		return {
+			.displayName=u"Celeste"_s,
+			.text=u"message %1 just checking in to see how the stream is going today"_s.arg(StringConvert::Integer(index)),
+			.color=QColor(0x8A,0x2B,0xE2)
+		};
+	}
+
+	// paints the window into an offscreen image once per frame, paced to the frame rate in real time
+	// so animations advance the way they would on stream, and reports what the paints cost
+	static void Render(benchmark::State &state,const Script &script)
+	{
+		Window window;
+		window.setFixedSize(BENCH_FRAME_SIZE);
+		window.show();
+		QImage frame(BENCH_FRAME_SIZE,QImage::Format_ARGB32_Premultiplied);
+		const double baseline=PeakResidentMegabytes();
+
+		std::vector<double> samples;
+		samples.reserve(BENCH_FRAMES);
+		std::chrono::steady_clock::time_point due=std::chrono::steady_clock::now();
+		int index=0;
+		for (auto _ : state)
+		{
+			script(window,index++);
+			QCoreApplication::processEvents(); // timers, animations, and queued work run between frames, as they would in the live event loop
+
+			const std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+			window.render(&frame);
+			const std::chrono::duration<double,std::micro> elapsed=std::chrono::steady_clock::now()-start;
+			state.SetIterationTime(elapsed.count()/1000000.0);
+			samples.push_back(elapsed.count());
+
+			due+=BENCH_FRAME_INTERVAL;
+			std::this_thread::sleep_until(due);
+		}
+
+		if (samples.empty()) return;
+		std::sort(samples.begin(),samples.end());
+		auto percentile=[&samples](double fraction) {
+			return samples[std::min(samples.size()-1,static_cast<size_t>(fraction*static_cast<double>(samples.size())))];
+		};
+		state.counters["p50_us"]=percentile(0.5);
+		state.counters["p90_us"]=percentile(0.9);
+		state.counters["p99_us"]=percentile(0.99);
+		state.counters["max_us"]=samples.back();
+		state.counters["over_budget"]=static_cast<double>(std::count_if(samples.begin(),samples.end(),[](double sample) { return sample > static_cast<double>(BENCH_FRAME_INTERVAL.count()); }));
+
+		// the high water mark only ever rises, so growth is what this pane pushed it past everything before it
+		const double peak=PeakResidentMegabytes();
+		state.counters["peak_rss_mb"]=peak;
+		state.counters["peak_rss_growth_mb"]=peak-baseline;
+	}
+}
+
+static void BM_RenderStatus(benchmark::State &state)
+{
+	Bench::Render(state,[](Window &window,int frame) {
+		if (frame % BENCH_CHAT_MESSAGE_INTERVAL == 0) emit window.Print(u"status line %1"_s.arg(StringConvert::Integer(frame)));
+	});
+}
+BENCHMARK(BM_RenderStatus)->Iterations(BENCH_FRAMES)->UseManualTime()->Unit(benchmark::kMicrosecond);
+
+static void BM_RenderChat(benchmark::State &state)
+{
+	Bench::Render(state,[](Window &window,int frame) {
+		if (frame == 0) window.ShowChat();
+		if (frame % BENCH_CHAT_MESSAGE_INTERVAL == 0) emit window.ChatMessage(Bench::ChatLine(frame));
+	});
+}
+BENCHMARK(BM_RenderChat)->Iterations(BENCH_FRAMES)->UseManualTime()->Unit(benchmark::kMicrosecond);
+
+static void BM_RenderAnnounce(benchmark::State &state)
+{
+	Bench::Render(state,[](Window &window,int frame) {
+		if (frame == 0) window.AnnounceRedemption(u"Celeste"_s,u"Hydrate"_s,u"drink some water, it's been an hour"_s);
+	});
+}
+BENCHMARK(BM_RenderAnnounce)->Iterations(BENCH_FRAMES)->UseManualTime()->Unit(benchmark::kMicrosecond);
+
+static void BM_RenderImageAnnounce(benchmark::State &state)
+{
+	Bench::Render(state,[](Window &window,int frame) {
+		if (frame == 0) window.Shoutout(u"Celeste"_s,u"Building a Twitch bot one hot path at a time"_s,std::make_shared<QImage>(Bench::Portrait(300)));
+	});
+}
+BENCHMARK(BM_RenderImageAnnounce)->Iterations(BENCH_FRAMES)->UseManualTime()->Unit(benchmark::kMicrosecond);
+
+static void BM_RenderCurrentSong(benchmark::State &state)
+{
+	Bench::Render(state,[](Window &window,int frame) {
+		if (frame == 0) window.ShowCurrentSong(u"Midnight City"_s,u"Hurry Up, We're Dreaming"_s,u"M83"_s,Bench::Portrait(512));
+	});
+}
+BENCHMARK(BM_RenderCurrentSong)->Iterations(BENCH_FRAMES)->UseManualTime()->Unit(benchmark::kMicrosecond);
+
+static void BM_RenderScrolling(benchmark::State &state)
+{
+	Bench::Render(state,[](Window &window,int frame) {
+		if (frame != 0) return;
+		std::vector<std::tuple<QString,QStringList,QString>> descriptions;
+		for (int index=0; index < BENCH_COMMAND_COUNT; index++) descriptions.push_back({u"command%1"_s.arg(StringConvert::Integer(index)),{u"alias%1"_s.arg(StringConvert::Integer(index))},u"does something useful for the stream"_s});
+		window.ShowCommandList(descriptions);
+	});
+}
+BENCHMARK(BM_RenderScrolling)->Iterations(BENCH_FRAMES)->UseManualTime()->Unit(benchmark::kMicrosecond);
+
+// there's no video that can be bundled, so this one only runs when pointed at one
+static void BM_RenderVideo(benchmark::State &state)
+{
+	const QString path=qEnvironmentVariable(BENCH_VIDEO_VARIABLE);
+	if (path.isEmpty())
+	{
+		state.SkipWithError("Set CELESTE_BENCH_VIDEO to a video file to measure video panes");
+		return;
+	}
+	Bench::Render(state,[path](Window &window,int frame) {
+		if (frame == 0) window.PlayVideo(path);
+	});
+}
+BENCHMARK(BM_RenderVideo)->Iterations(BENCH_FRAMES)->UseManualTime()->Unit(benchmark::kMicrosecond);
+
+// everything back to back the way a busy stream throws it at the window, chat running underneath
+static void BM_RenderSequence(benchmark::State &state)
+{
+	Bench::Render(state,[](Window &window,int frame) {
+		switch (frame)
+		{
+		case 0:
+			window.ShowChat();
+			break;
+		case 30:
+			window.AnnounceRedemption(u"Celeste"_s,u"Hydrate"_s,u"drink some water, it's been an hour"_s);
+			break;
+		case 60:
+			window.Shoutout(u"Celeste"_s,u"Building a Twitch bot one hot path at a time"_s,std::make_shared<QImage>(Bench::Portrait(300)));
+			break;
+		case 90:
+			window.ShowCommand(u"uptime"_s,u"shows how long the stream has been live"_s);
+			break;
+		case 120:
+			window.AnnounceHypeTrainProgress(2,0.6);
+			break;
+		}
+		if (frame % BENCH_CHAT_MESSAGE_INTERVAL == 0) emit window.ChatMessage(Bench::ChatLine(frame));
+	});
+}
+BENCHMARK(BM_RenderSequence)->Iterations(BENCH_FRAMES)->UseManualTime()->Unit(benchmark::kMicrosecond);
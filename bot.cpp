@@ -6,7 +6,11 @@
 #include <ranges>
 #include "bot.h"
 #include "globals.h"
+#include "imaging.h"
 #include "twitch.h"
+#include "metrics.h"
+#include "trace.h"
+#include "utf8.h"
 
 const char *COMMANDS_LIST_FILENAME="commands.json";
 const char *COMMAND_TYPE_NATIVE="native";
@@ -35,6 +39,8 @@ const char *JSON_KEY_BOT="bot";
 const char *JSON_KEY_LIMIT_COMMANDS="limited";
 const char *JSON_KEY_SUBSCRIBED="subscribed";
 const char *JSON_ARRAY_EMPTY="[]";
+const char *SNAPSHOT_SECTION_VIEWERS="viewers";
+const char *SNAPSHOT_SECTION_BADGES="badges";
 const char *SETTINGS_CATEGORY_VIBE="Vibe";
 const char *SETTINGS_CATEGORY_COMMANDS="Commands";
 const char *SETTINGS_CATEGORY_EVENTS="Events";
@@ -62,6 +68,16 @@ const char *FILE_OPERATION_WRITE="write";
 const char *FILE_ERROR_TEMPLATE_COMMANDS_LIST="Failed to %1 command list file: %2";
 const char *FILE_ERROR_TEMPLATE_VIBE_PLAYLIST="Failed to %1 vibe playlist list file: %2";
 
+// viewer attributes are packed into one integer per viewer in the snapshot
+enum ViewerAttributeFlag
+{
+	VIEWER_ATTRIBUTE_COMMANDS=1 << 0,
+	VIEWER_ATTRIBUTE_WELCOMED=1 << 1,
+	VIEWER_ATTRIBUTE_BOT=1 << 2,
+	VIEWER_ATTRIBUTE_LIMITED=1 << 3,
+	VIEWER_ATTRIBUTE_SUBSCRIBED=1 << 4
+};
+
 const Bot::CommandTypeLookup Bot::COMMAND_TYPE_LOOKUP={
 	{COMMAND_TYPE_NATIVE,CommandType::NATIVE},
 	{COMMAND_TYPE_VIDEO,CommandType::VIDEO},
@@ -69,13 +85,35 @@ const Bot::CommandTypeLookup Bot::COMMAND_TYPE_LOOKUP={
 	{COMMAND_TYPE_PULSAR,CommandType::PULSAR}
 };
 
+// label values for the dispatch latency metrics, which stay the same when commands are renamed
+const std::unordered_map<NativeCommandFlag,const char*> NATIVE_COMMAND_FLAG_LABELS={
+	{NativeCommandFlag::AGENDA,"agenda"},
+	{NativeCommandFlag::CATEGORY,"category"},
+	{NativeCommandFlag::COMMANDS,"commands"},
+	{NativeCommandFlag::EMOTE,"emote"},
+	{NativeCommandFlag::FOLLOWAGE,"followage"},
+	{NativeCommandFlag::HTML,"html"},
+	{NativeCommandFlag::LIMIT,"limit"},
+	{NativeCommandFlag::PANIC,"panic"},
+	{NativeCommandFlag::SHOUTOUT,"shoutout"},
+	{NativeCommandFlag::SONG,"song"},
+	{NativeCommandFlag::TIMEZONE,"timezone"},
+	{NativeCommandFlag::TITLE,"title"},
+	{NativeCommandFlag::TOTAL_TIME,"totaltime"},
+	{NativeCommandFlag::UPTIME,"uptime"},
+	{NativeCommandFlag::VIBE,"vibe"},
+	{NativeCommandFlag::VOLUME,"volume"}
+};
+
 Bot::BadgeIconURLsLookup Bot::badgeIconURLs;
 std::chrono::milliseconds Bot::launchTimestamp=TimeConvert::Now();
 
-Bot::Bot(Music::Player &musicPlayer,Security &security,QObject *parent) : QObject(parent),
+Bot::Bot(Music::Player &musicPlayer,Security &security,Snapshot &snapshot,Presence &presence,QObject *parent) : QObject(parent),
 	vibeKeeper(musicPlayer),
 	roaster(false,100,this),
 	security(security),
+	snapshot(snapshot),
+	presence(presence),
 	settingInactivityCooldown(SETTINGS_CATEGORY_EVENTS,"InactivityCooldown",1800000),
 	settingHelpCooldown(SETTINGS_CATEGORY_EVENTS,"HelpCooldown",300000),
 	settingTextWallThreshold(SETTINGS_CATEGORY_EVENTS,"TextWallThreshold",400),
@@ -123,13 +161,28 @@ Bot::Bot(Music::Player &musicPlayer,Security &security,QObject *parent) : QObjec
 	DeclareCommand({settingCommandNameTotalTime,"Show how many total hours stream has ever been live",CommandType::NATIVE,false},NativeCommandFlag::TOTAL_TIME);
 	DeclareCommand({settingCommandNameVibe,"Start the playlist of music for the stream",CommandType::NATIVE,true},NativeCommandFlag::VIBE);
 	DeclareCommand({settingCommandNameVibeVolume,"Adjust the volume of the vibe keeper",CommandType::NATIVE,true},NativeCommandFlag::VOLUME);
+	Network::CachePolicy(Twitch::Endpoint(Twitch::ENDPOINT_STREAM_INFORMATION),std::chrono::seconds(30));
+	Network::CachePolicy(Twitch::Endpoint(Twitch::ENDPOINT_GAME_INFORMATION),std::chrono::days(7));
+	Network::CachePolicy(Twitch::Endpoint(Twitch::ENDPOINT_BADGES),std::chrono::days(1));
+
+	snapshot.Section(SNAPSHOT_SECTION_VIEWERS,Filesystem::DataPath().filePath(VIEWER_ATTRIBUTES_FILENAME),&Bot::BuildViewerAttributes);
 	LoadViewerAttributes();
 
+	// the badge catalog is still downloaded once security is ready, but chat can show badges from the last session until then
+	if (std::optional<QCborValue> section=snapshot.Find(SNAPSHOT_SECTION_BADGES); section)
+	{
+		const QCborMap sets=section->toMap();
+		for (auto set=sets.begin(); set != sets.end(); ++set)
+		{
+			const QCborMap versions=set.value().toMap();
+			for (auto version=versions.begin(); version != versions.end(); ++version) badgeIconURLs[set.key().toString()][version.key().toString()]=version.value().toString();
+		}
+	}
+
 	if (settingRoasts) LoadRoasts();
-	LoadBadgeIconURLs();
 	StartClocks();
 
-	lastRaid=QDateTime::currentDateTime().addMSecs(static_cast<qint64>(0)-static_cast<qint64>(settingRaidInterruptDuration));
+	lastRaid=Clock::Current().addMSecs(static_cast<qint64>(0)-static_cast<qint64>(settingRaidInterruptDuration));
 
 	connect(&vibeKeeper,&Music::Player::Print,this,&Bot::Print);
 }
@@ -345,6 +398,24 @@ const Command::Lookup& Bot::Commands() const
 
 bool Bot::LoadViewerAttributes() // FIXME: have this throw an exception rather than return a bool
 {
+	if (std::optional<QCborValue> section=snapshot.Find(SNAPSHOT_SECTION_VIEWERS); section)
+	{
+		const QCborMap entries=section->toMap();
+		viewers.reserve(entries.size());
+		for (auto viewer=entries.begin(); viewer != entries.end(); ++viewer)
+		{
+			const qint64 flags=viewer.value().toInteger();
+			viewers[viewer.key().toString()]={
+				(flags & VIEWER_ATTRIBUTE_COMMANDS) != 0,
+				(flags & VIEWER_ATTRIBUTE_WELCOMED) != 0,
+				(flags & VIEWER_ATTRIBUTE_BOT) != 0,
+				(flags & VIEWER_ATTRIBUTE_LIMITED) != 0,
+				(flags & VIEWER_ATTRIBUTE_SUBSCRIBED) != 0
+			};
+		}
+		return true;
+	}
+
 	QFile viewerAttributesFile(Filesystem::DataPath().filePath(VIEWER_ATTRIBUTES_FILENAME));
 	if (!viewerAttributesFile.exists()) return true; // a non-existent attributes file is valid if this is a first run
 
@@ -364,20 +435,41 @@ bool Bot::LoadViewerAttributes() // FIXME: have this throw an exception rather t
 		return false;
 	}
 
+	const QJsonObject entries=json.object();
+	for (QJsonObject::const_iterator viewer=entries.begin(); viewer != entries.end(); ++viewer) viewers[viewer.key()]=ResolveViewerAttributes(viewer->toObject());
+
+	return true;
+}
+
+Viewer::Attributes Bot::ResolveViewerAttributes(const QJsonObject &attributes)
+{
+	return {
+		Container::Resolve(attributes,JSON_KEY_COMMANDS,true).toBool(),
+		Container::Resolve(attributes,JSON_KEY_WELCOME,false).toBool(),
+		Container::Resolve(attributes,JSON_KEY_BOT,false).toBool(),
+		Container::Resolve(attributes,JSON_KEY_LIMIT_COMMANDS,false).toBool(),
+		Container::Resolve(attributes,JSON_KEY_SUBSCRIBED,false).toBool()
+	};
+}
+
+QCborValue Bot::BuildViewerAttributes(const QByteArray &source)
+{
+	// runs on the snapshot's thread, so it can't touch the bot
+	const QJsonDocument json=QJsonDocument::fromJson(source.isEmpty() ? "{}" : source);
+	if (json.isNull()) return QCborValue();
+
+	QCborMap result;
 	const QJsonObject entries=json.object();
 	for (QJsonObject::const_iterator viewer=entries.begin(); viewer != entries.end(); ++viewer)
 	{
-		const QJsonObject attributes=viewer->toObject();
-		viewers[viewer.key()]={
-			Container::Resolve(attributes,JSON_KEY_COMMANDS,true).toBool(),
-			Container::Resolve(attributes,JSON_KEY_WELCOME,false).toBool(),
-			Container::Resolve(attributes,JSON_KEY_BOT,false).toBool(),
-			Container::Resolve(attributes,JSON_KEY_LIMIT_COMMANDS,false).toBool(),
-			Container::Resolve(attributes,JSON_KEY_SUBSCRIBED,false).toBool()
-		};
+		const Viewer::Attributes attributes=ResolveViewerAttributes(viewer->toObject());
+		result.insert(viewer.key(),(attributes.commands ? VIEWER_ATTRIBUTE_COMMANDS : 0)
+			| (attributes.welcomed ? VIEWER_ATTRIBUTE_WELCOMED : 0)
+			| (attributes.bot ? VIEWER_ATTRIBUTE_BOT : 0)
+			| (attributes.limited ? VIEWER_ATTRIBUTE_LIMITED : 0)
+			| (attributes.subscribed ? VIEWER_ATTRIBUTE_SUBSCRIBED : 0));
 	}
-
-	return true;
+	return result;
 }
 
 void Bot::SaveViewerAttributes(bool reset)
@@ -474,52 +566,74 @@ void Bot::LoadRoasts()
 
 void Bot::LoadBadgeIconURLs()
 {
+	// needs a validated token, so this waits for security to initialize instead of running from the constructor
 	Network::Request({Twitch::Endpoint(Twitch::ENDPOINT_BADGES)},Network::Method::GET,[this](QNetworkReply *reply) {
-		static const char *JSON_KEY_ID="id";
-		static const char *JSON_KEY_SET_ID="set_id";
-		static const char *JSON_KEY_VERSIONS="versions";
-		static const char *JSON_KEY_IMAGE_URL="image_url_1x";
-
-		const JSON::ParseResult parsedJSON=JSON::Parse(reply->readAll());
-		if (!parsedJSON)
-		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_LOAD_BADGES,parsedJSON.error));
-			return;
-		}
-
-		const QJsonObject object=parsedJSON().object();
-		auto jsonFieldData=object.find(JSON::Keys::DATA);
-		if (jsonFieldData == object.end()) return;
-		for (const QJsonValue &set : jsonFieldData->toArray())
+		ParseBadgeIconURLs(reply->readAll());
+		QCborMap sets;
+		for (const std::pair<const QString,std::unordered_map<QString,QString>> &set : badgeIconURLs)
 		{
-			const QJsonObject objectBadgeSet=set.toObject();
-			auto jsonFieldSetID=objectBadgeSet.find(JSON_KEY_SET_ID);
-			auto jsonFieldVersions=objectBadgeSet.find(JSON_KEY_VERSIONS);
-			if (jsonFieldSetID == objectBadgeSet.end() || jsonFieldVersions == objectBadgeSet.end()) return;
-			for (const QJsonValue &version : jsonFieldVersions->toArray())
-			{
-				const QJsonObject objectImageVersions=version.toObject();
-				auto jsonFieldID=objectImageVersions.find(JSON_KEY_ID);
-				auto jsonFieldVersionURL=objectImageVersions.find(JSON_KEY_IMAGE_URL);
-				if (jsonFieldID == objectImageVersions.end() || jsonFieldVersionURL == objectImageVersions.end()) return;
-				badgeIconURLs[jsonFieldSetID->toString()][jsonFieldID->toString()]=jsonFieldVersionURL->toString(); // NOTE: I'm not sure how to construct in place here
-			}
+			QCborMap versions;
+			for (const std::pair<const QString,QString> &version : set.second) versions.insert(version.first,version.second);
+			sets.insert(set.first,versions);
 		}
+		snapshot.Store(SNAPSHOT_SECTION_BADGES,sets);
+		emit BadgeIconURLsLoaded();
 	},{},{
 		{NETWORK_HEADER_AUTHORIZATION,security.Bearer(security.OAuthToken())},
 		{NETWORK_HEADER_CLIENT_ID,security.ClientID()}
 	});
 }
 
+void Bot::ParseBadgeIconURLs(const QByteArray &data)
+{
+	static const char *JSON_KEY_ID="id";
+	static const char *JSON_KEY_SET_ID="set_id";
+	static const char *JSON_KEY_VERSIONS="versions";
+	static const char *JSON_KEY_IMAGE_URL="image_url_1x";
+
+	const JSON::ParseResult parsedJSON=JSON::Parse(data);
+	if (!parsedJSON)
+	{
+		emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_LOAD_BADGES,parsedJSON.error));
+		return;
+	}
+
+	const QJsonObject object=parsedJSON().object();
+	auto jsonFieldData=object.find(JSON::Keys::DATA);
+	if (jsonFieldData == object.end()) return;
+	for (const QJsonValue &set : jsonFieldData->toArray())
+	{
+		const QJsonObject objectBadgeSet=set.toObject();
+		auto jsonFieldSetID=objectBadgeSet.find(JSON_KEY_SET_ID);
+		auto jsonFieldVersions=objectBadgeSet.find(JSON_KEY_VERSIONS);
+		if (jsonFieldSetID == objectBadgeSet.end() || jsonFieldVersions == objectBadgeSet.end()) return;
+		for (const QJsonValue &version : jsonFieldVersions->toArray())
+		{
+			const QJsonObject objectImageVersions=version.toObject();
+			auto jsonFieldID=objectImageVersions.find(JSON_KEY_ID);
+			auto jsonFieldVersionURL=objectImageVersions.find(JSON_KEY_IMAGE_URL);
+			if (jsonFieldID == objectImageVersions.end() || jsonFieldVersionURL == objectImageVersions.end()) return;
+			badgeIconURLs[jsonFieldSetID->toString()][jsonFieldID->toString()]=jsonFieldVersionURL->toString(); // NOTE: I'm not sure how to construct in place here
+		}
+	}
+}
+
 void Bot::StartClocks()
 {
-	inactivityClock.setInterval(TimeConvert::Interval(std::chrono::milliseconds(settingInactivityCooldown)));
-	if (settingRoasts) connect(&inactivityClock,&QTimer::timeout,&roaster,&Music::Player::Start);
-	inactivityClock.start();
+	inactivityClock.Interval(static_cast<std::chrono::milliseconds>(settingInactivityCooldown));
+	if (settingRoasts) connect(&inactivityClock,&Clock::Timer::Timeout,&roaster,&Music::Player::Start);
+	inactivityClock.Start();
 
-	helpClock.setInterval(TimeConvert::Interval(std::chrono::milliseconds(settingHelpCooldown)));
-	connect(&helpClock,&QTimer::timeout,this,&Bot::DispatchHelpText);
-	helpClock.start();
+	helpClock.Interval(static_cast<std::chrono::milliseconds>(settingHelpCooldown));
+	connect(&helpClock,&Clock::Timer::Timeout,this,&Bot::DispatchHelpText);
+	helpClock.Start();
+
+	settingInactivityCooldown.Watch(this,[this]() {
+		inactivityClock.Interval(static_cast<std::chrono::milliseconds>(settingInactivityCooldown));
+	});
+	settingHelpCooldown.Watch(this,[this]() {
+		helpClock.Interval(static_cast<std::chrono::milliseconds>(settingHelpCooldown));
+	});
 }
 
 void Bot::Ping()
@@ -579,7 +693,8 @@ void Bot::Subscription(const QString &login,const QString &displayName)
 
 void Bot::Raid(const QString &viewer,const unsigned int viewers)
 {
-	lastRaid=QDateTime::currentDateTime();
+	Trace::Instant("bot","raid",viewer);
+	lastRaid=Clock::Current();
 	if (settingRaidSound) emit AnnounceRaid(viewer,viewers,settingRaidSound);
 }
 
@@ -605,6 +720,7 @@ void Bot::RestoreMusic()
 
 void Bot::DispatchArrival(const QString &login)
 {
+	Trace::Span span("bot","arrival",login);
 	if (auto viewer=viewers.find(login); viewer != viewers.end())
 	{
 		// if the viewer is a bot or is already welcomed, bail
@@ -621,12 +737,16 @@ void Bot::DispatchArrival(const QString &login)
 	}
 
 	// viewer (whether they've been seen before or not) hasn't been welcomed yet
+	std::shared_ptr<Trace::Correlation> correlation=Trace::Correlation::Current();
+	if (correlation) correlation->Retype("arrival");
 	Viewer::Remote *viewer=new Viewer::Remote(security,login);
 	connect(viewer,&Viewer::Remote::Print,this,&Bot::Print);
-	connect(viewer,&Viewer::Remote::Recognized,viewer,[this](const Viewer::Local &viewer) {
-		if (security.Administrator() == viewer.Name() || QDateTime::currentDateTime().toMSecsSinceEpoch()-lastRaid.toMSecsSinceEpoch() < static_cast<qint64>(settingRaidInterruptDuration)) return;
+	connect(viewer,&Viewer::Remote::Recognized,viewer,[this,correlation](const Viewer::Local &viewer) {
+		Trace::Correlation::Scope scope(correlation,"viewer recognized");
+		if (security.Administrator() == viewer.Name() || Clock::Current().toMSecsSinceEpoch()-lastRaid.toMSecsSinceEpoch() < static_cast<qint64>(settingRaidInterruptDuration)) return;
 		Viewer::ProfileImage::Remote *profileImage=viewer.ProfileImage();
-		connect(profileImage,&Viewer::ProfileImage::Remote::Retrieved,profileImage,[this,viewer](std::shared_ptr<QImage> profileImage) {
+		connect(profileImage,&Viewer::ProfileImage::Remote::Retrieved,profileImage,[this,viewer,correlation](std::shared_ptr<QImage> profileImage) {
+			Trace::Correlation::Scope scope(correlation,"profile image retrieved");
 			// Do we have a sound configured to announce them with? If so, fire the signal.
 			if (settingArrivalSound) emit AnnounceArrival(viewer.DisplayName(),profileImage,File::List(settingArrivalSound).Random());
 
@@ -636,7 +756,7 @@ void Bot::DispatchArrival(const QString &login)
 			}))
 			{
 				// look through the list of viewers attached to the command
-				// we're looking for when all of the viewers in the list have been welcomed _except_ the one that just arrived
+				// we're looking for when all of the viewers in the list have been welcomed and are still here _except_ the one that just arrived
 				bool triggerViewerIsCandidate=false;
 				if (std::all_of(candidateCommand.Viewers().begin(),candidateCommand.Viewers().end(),[&triggerViewerIsCandidate,&triggerViewer=viewer,this](const QString &name) {
 					auto candidateViewer=viewers.find(name);
@@ -651,8 +771,8 @@ void Bot::DispatchArrival(const QString &login)
 						}
 						else
 						{
-							// otherwise, we want to make sure this person has been welcomed already
-							if (!candidateViewer->second.welcomed) return false;
+							// otherwise, we want to make sure this person has been welcomed already and hasn't left since
+							if (!candidateViewer->second.welcomed || !presence.Present(name)) return false;
 						}
 						return true;
 					}
@@ -676,6 +796,8 @@ void Bot::ParseChatMessage(const QString &prefix,const QString &source,const QSt
 	// only parameter. This may change in the future, so passing it in and marking it
 	// unused to shut the compiler up for now.
 	Q_UNUSED(parameters)
+	Trace::Span span("bot","chat message");
+	if (std::shared_ptr<Trace::Correlation> correlation=Trace::Correlation::Current()) correlation->Retype("chat");
 
 	using StringViewLookup=std::unordered_map<QStringView,QStringView>;
 	using StringViewTakeResult=std::optional<QStringView>;
@@ -762,6 +884,7 @@ void Bot::ParseChatMessage(const QString &prefix,const QString &source,const QSt
 	StringViewTakeResult user=StringView::Take(*hostmask,'!');
 	if (!user) return;
 	login=*user;
+	presence.Active(login.toString());
 
 	// determine if this is a command, and if so, process it as such
 	// and if it's valid, we're done
@@ -785,19 +908,29 @@ void Bot::ParseChatMessage(const QString &prefix,const QString &source,const QSt
 	}
 
 	// set emote name and check for wall of text
-	int emoteCharacterCount=0;
+	// Twitch counts emote positions in codepoints, so they're moved over to UTF-16 indices here, once, for everything downstream
+	const UTF16::CodepointMap codepoints(remainingText);
+	qsizetype emoteCharacterCount=0;
+	std::vector<Chat::Emote> emotes;
+	emotes.reserve(chatMessage.emotes.size());
 	for (Chat::Emote &emote : chatMessage.emotes)
 	{
-		const QStringView name=remainingText.mid(emote.start,1+emote.end-emote.start); // end is an index, not a size, so we have to add 1 to get the size
-		emoteCharacterCount+=name.size();
-		emote.name=name.toString();
+		const qsizetype start=codepoints.Index(emote.start);
+		const qsizetype end=codepoints.Index(static_cast<qsizetype>(emote.end)+1); // end is an index, not a size, so we have to add 1 to get past it
+		if (end <= start) continue; // range is outside of the message
+		emoteCharacterCount+=std::min<qsizetype>(codepoints.Codepoints(),static_cast<qsizetype>(emote.end)+1)-emote.start;
+		emote.name=remainingText.mid(start,end-start).toString();
+		emote.start=static_cast<unsigned int>(start);
+		emote.end=static_cast<unsigned int>(end-1);
 		DownloadEmote(emote); // once we know the emote name, we can determine the path, which means we can download it (download will set the path in the struct)
+		emotes.push_back(std::move(emote));
 	}
-	if (remainingText.size()-emoteCharacterCount > static_cast<int>(settingTextWallThreshold) && settingTextWallSound) emit AnnounceTextWall(message,settingTextWallSound);
+	chatMessage.emotes=std::move(emotes);
+	if (codepoints.Codepoints()-emoteCharacterCount > static_cast<int>(settingTextWallThreshold) && settingTextWallSound) emit AnnounceTextWall(message,settingTextWallSound);
 
-	chatMessage.text=remainingText.toString().toHtmlEscaped();
+	chatMessage.text=remainingText.toString(); // the chat pane lays it out as plain text, so there's nothing to escape
 	emit ChatMessage(chatMessage);
-	inactivityClock.start();
+	inactivityClock.Start();
 }
 
 std::optional<QString> Bot::DownloadBadgeIcon(const QString &badge,const QString &version)
@@ -817,8 +950,9 @@ std::optional<QString> Bot::DownloadBadgeIcon(const QString &badge,const QString
 				emit Print(QString("Failed to download badge %1: %2").arg(badgeIconURL,downloadReply->errorString()));
 				return;
 			}
-			if (!QImage::fromData(downloadReply->readAll()).save(badgePath)) emit Print(QString("Failed to save badge %2").arg(badgePath));
-			emit RefreshChat();
+			Imaging::Decoder *decoder=new Imaging::Decoder(downloadReply->readAll(),QSize(),badgePath);
+			connect(decoder,&Imaging::Decoder::Print,this,&Bot::Print);
+			connect(decoder,&Imaging::Decoder::Decoded,this,&Bot::RefreshChat);
 		});
 	}
 	return badgePath;
@@ -835,8 +969,9 @@ void Bot::DownloadEmote(Chat::Emote &emote)
 				emit Print(QString("Failed to download emote %1: %2").arg(emote.name,downloadReply->errorString()));
 				return;
 			}
-			if (!QImage::fromData(downloadReply->readAll()).save(emote.path)) emit Print(QString("Failed to save emote %1 to %2").arg(emote.name,emote.path));
-			emit RefreshChat();
+			Imaging::Decoder *decoder=new Imaging::Decoder(downloadReply->readAll(),QSize(),emote.path);
+			connect(decoder,&Imaging::Decoder::Print,this,&Bot::Print);
+			connect(decoder,&Imaging::Decoder::Decoded,this,&Bot::RefreshChat);
 		});
 	}
 }
@@ -851,6 +986,7 @@ std::optional<QString> Bot::ParseCommand(QStringView &message)
 
 void Bot::DispatchCommand(JSON::SignalPayload *response,const QString &name,const QString &login)
 {
+	Trace::Correlation::Scope correlation(response->correlation,"dequeued");
 	const QString message=response->context.toString();
 	if (!message.isNull())
 	{
@@ -873,10 +1009,12 @@ void Bot::DispatchCommand(JSON::SignalPayload *response,const QString &name,cons
 
 bool Bot::DispatchCommand(const QString name,const Chat::Message &chatMessage,const QString &login,bool html) // build a command object from a command name and a chat message and forward
 {
+	Trace::Span span("bot","command",name);
 	// FIRST! determine if command exists
 	auto commandCandidate=commands.find(name);
 	if (commandCandidate == commands.end()) return false;
 	const Command &command=commandCandidate->second;
+	if (std::shared_ptr<Trace::Correlation> correlation=Trace::Correlation::Current()) correlation->Retype("command");
 
 	// deny command if user must be a mod and isn't
 	if (command.Protected() && !chatMessage.Privileged())
@@ -894,17 +1032,18 @@ bool Bot::DispatchCommand(const QString name,const Chat::Message &chatMessage,co
 	if (auto viewerCandidate=viewers.find(login); viewerCandidate != viewers.end())
 	{
 		Viewer::Attributes &viewer=viewerCandidate->second;
-		if (viewer.limited && std::chrono::duration_cast<std::chrono::minutes>(std::chrono::system_clock::now()-viewer.commandTimestamp) < std::chrono::minutes(static_cast<qint64>(settingCommandCooldown)) && !chatMessage.Privileged())
+		if (viewer.limited && std::chrono::duration_cast<std::chrono::minutes>(Clock::Now()-viewer.commandTimestamp) < std::chrono::minutes(static_cast<qint64>(settingCommandCooldown)) && !chatMessage.Privileged())
 		{
 			emit AnnounceDeniedCommand(File::List(settingDeniedCommandVideo).Random());
 			return false;
 		}
-		viewer.commandTimestamp=std::chrono::system_clock::now();
+		viewer.commandTimestamp=Clock::Now();
 	}
 
 	// command is reformatting text, so feed the formatted chat message back into the system
 	if (html && command.Type() == CommandType::NATIVE && nativeCommandFlags.at(command.Name()) == NativeCommandFlag::HTML)
 	{
+		const std::chrono::steady_clock::time_point dispatched=std::chrono::steady_clock::now();
 		emit ChatMessage({
 			.displayName=chatMessage.displayName,
 			.text=chatMessage.text,
@@ -913,8 +1052,10 @@ bool Bot::DispatchCommand(const QString name,const Chat::Message &chatMessage,co
 			.emotes={},
 			.action=chatMessage.action,
 			.broadcaster=chatMessage.broadcaster,
-			.moderator=chatMessage.moderator
+			.moderator=chatMessage.moderator,
+			.html=true
 		});
+		DispatchTime(command).Record(dispatched);
 		return true;
 	}
 
@@ -924,9 +1065,12 @@ bool Bot::DispatchCommand(const QString name,const Chat::Message &chatMessage,co
 
 void Bot::DispatchCommand(const Command &command,const QString &login)
 {
+	// measured from here, so the latency includes looking up the viewer as well as running the command
+	const std::chrono::steady_clock::time_point dispatched=std::chrono::steady_clock::now();
 	Viewer::Remote *viewer=new Viewer::Remote(security,login);
 	connect(viewer,&Viewer::Remote::Print,this,&Bot::Print);
-	connect(viewer,&Viewer::Remote::Recognized,viewer,[this,command](const Viewer::Local &viewer) {
+	connect(viewer,&Viewer::Remote::Recognized,viewer,[this,command,dispatched,correlation=Trace::Correlation::Current()](const Viewer::Local &viewer) {
+		Trace::Correlation::Scope scope(correlation,"viewer recognized");
 		switch (command.Type())
 		{
 		case CommandType::VIDEO:
@@ -999,9 +1143,23 @@ void Bot::DispatchCommand(const Command &command,const QString &login)
 		case CommandType::BLANK:
 			break;
 		};
+		DispatchTime(command).Record(dispatched);
+		Trace::Complete("bot","command taking effect",dispatched,command.Name());
 	});
 }
 
+Metrics::Histogram& Bot::DispatchTime(const Command &command) const
+{
+	QString type=u"blank"_s;
+	for (const std::pair<const QString,CommandType> &candidate : COMMAND_TYPE_LOOKUP)
+	{
+		if (candidate.second == command.Type()) type=candidate.first;
+	}
+	Metrics::Labels labels={{u"type"_s,type}};
+	if (command.Type() == CommandType::NATIVE) labels.push_back({u"command"_s,NATIVE_COMMAND_FLAG_LABELS.at(nativeCommandFlags.at(command.Name()))});
+	return Metrics::FindHistogram(u"celeste_command_dispatch_seconds"_s,u"Time from a command being dispatched to it taking effect"_s,labels);
+}
+
 void Bot::DispatchVideo(Command command)
 {
 	// FIXME: What if there are no videos in the directory?
@@ -1056,7 +1214,7 @@ void Bot::DispatchFollowage(const Viewer::Local &viewer)
 			return;
 		}
 		const QDateTime start=QDateTime::fromString(jsonFieldFollowDate->toString(),Qt::ISODate);
-		std::chrono::milliseconds duration=static_cast<std::chrono::milliseconds>(start.msecsTo(QDateTime::currentDateTimeUtc()));
+		std::chrono::milliseconds duration=static_cast<std::chrono::milliseconds>(start.msecsTo(Clock::Current().toUTC()));
 		std::chrono::years years=std::chrono::duration_cast<std::chrono::years>(duration);
 		std::chrono::months months=std::chrono::duration_cast<std::chrono::months>(duration-years);
 		std::chrono::days days=std::chrono::duration_cast<std::chrono::days>(duration-years-months);
@@ -1078,7 +1236,7 @@ void Bot::DispatchPanic(const QString &name)
 	if (!outputFile.open(QIODevice::ReadOnly)) return;
 	outputText=QString(outputFile.readAll()).arg(name);
 	outputFile.close();
-	QString date=QDateTime::currentDateTime().toString("ddd d hh:mm:ss");
+	QString date=Clock::Current().toString("ddd d hh:mm:ss");
 	outputText=outputText.split("\n").join(QString("\n%1 ").arg(date));
 	emit Panic(date+"\n"+outputText);
 }
@@ -1086,7 +1244,8 @@ void Bot::DispatchPanic(const QString &name)
 void Bot::DispatchShoutout(Command command)
 {
 	Viewer::Remote *streamer=new Viewer::Remote(security,QString(command.Message()).remove("@"));
-	connect(streamer,&Viewer::Remote::Recognized,streamer,[this](const Viewer::Local &streamer) {
+	connect(streamer,&Viewer::Remote::Recognized,streamer,[this,correlation=Trace::Correlation::Current()](const Viewer::Local &streamer) {
+		Trace::Correlation::Scope scope(correlation,"streamer recognized");
 		// native Twitch shoutout
 		Network::Request({Twitch::Endpoint(Twitch::ENDPOINT_SHOUTOUTS)},Network::Method::POST,[this,streamerID=streamer.ID()](QNetworkReply *reply) {
 			// 204 is successful
@@ -1122,7 +1281,8 @@ void Bot::DispatchShoutout(Command command)
 		});
 		// bot shoutout
 		Viewer::ProfileImage::Remote *profileImage=streamer.ProfileImage();
-		connect(profileImage,&Viewer::ProfileImage::Remote::Retrieved,profileImage,[this,displayName=streamer.DisplayName(),description=streamer.Description()](std::shared_ptr<QImage> profileImage) {
+		connect(profileImage,&Viewer::ProfileImage::Remote::Retrieved,profileImage,[this,displayName=streamer.DisplayName(),description=streamer.Description(),correlation](std::shared_ptr<QImage> profileImage) {
+			Trace::Correlation::Scope scope(correlation,"profile image retrieved");
 			emit Shoutout(displayName,description,profileImage);
 		},Qt::QueuedConnection);
 	},Qt::QueuedConnection);
@@ -1179,7 +1339,7 @@ void Bot::DispatchUptime(bool total)
 		}
 
 		const QDateTime start=QDateTime::fromString(jsonFieldStartDate->toString(),Qt::ISODate);
-		std::chrono::milliseconds duration=static_cast<std::chrono::milliseconds>(start.msecsTo(QDateTime::currentDateTimeUtc()));
+		std::chrono::milliseconds duration=static_cast<std::chrono::milliseconds>(start.msecsTo(Clock::Current().toUTC()));
 		if (total) duration+=std::chrono::minutes(static_cast<qint64>(settingUptimeHistory));
 		std::chrono::hours hours=std::chrono::duration_cast<std::chrono::hours>(duration);
 		std::chrono::minutes minutes=std::chrono::duration_cast<std::chrono::minutes>(duration-hours);
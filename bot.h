@@ -13,6 +13,10 @@
 #include "entities.h"
 #include "settings.h"
 #include "security.h"
+#include "snapshot.h"
+#include "presence.h"
+
+namespace Metrics { class Histogram; }
 
 enum class NativeCommandFlag
 {
@@ -39,7 +43,7 @@ class Bot : public QObject
 	Q_OBJECT
 public:
 	using NativeCommandFlagLookup=std::unordered_map<QString,NativeCommandFlag>;
-	Bot(Music::Player &musicPlayer,Security &security,QObject *parent=nullptr);
+	Bot(Music::Player &musicPlayer,Security &security,Snapshot &snapshot,Presence &presence,QObject *parent=nullptr);
 	Bot(const Bot& other)=delete;
 	Bot& operator=(const Bot &other)=delete;
 	void ToggleEmoteOnly();
@@ -69,10 +73,12 @@ protected:
 	std::unordered_map<QString,Viewer::Attributes> viewers;
 	Music::Player &vibeKeeper;
 	Music::Player roaster;
-	QTimer inactivityClock;
-	QTimer helpClock;
+	Clock::Timer inactivityClock;
+	Clock::Timer helpClock;
 	QDateTime lastRaid;
 	Security &security;
+	Snapshot &snapshot;
+	Presence &presence;
 	ApplicationSetting settingInactivityCooldown;
 	ApplicationSetting settingHelpCooldown;
 	ApplicationSetting settingTextWallThreshold;
@@ -109,8 +115,10 @@ protected:
 	void DeclareCommand(const Command &&command,NativeCommandFlag flag);
 	void StageRedemptionCommand(const QString &name,const QJsonObject &jsonObject);
 	bool LoadViewerAttributes();
+	static Viewer::Attributes ResolveViewerAttributes(const QJsonObject &attributes);
+	static QCborValue BuildViewerAttributes(const QByteArray &source);
 	void LoadRoasts();
-	void LoadBadgeIconURLs();
+	void ParseBadgeIconURLs(const QByteArray &data);
 	void StartClocks();
 	std::optional<CommandType> ValidCommandType(const QString &type);
 	void DownloadEmote(Chat::Emote &emote);
@@ -118,6 +126,7 @@ protected:
 	std::optional<QString> ParseCommand(QStringView &message);
 	bool DispatchCommand(const QString name,const Chat::Message &chatMessage,const QString &login,bool html=true);
 	void DispatchCommand(const Command &command,const QString &login);
+	Metrics::Histogram& DispatchTime(const Command &command) const;
 	void DispatchArrival(const QString &login);
 	void DispatchVideo(Command command);
 	void DispatchCommandList();
@@ -158,7 +167,9 @@ signals:
 	void AnnounceTextWall(const QString &message,const QString &audioPath);
 	void AnnounceDeniedCommand(const QString &videoPath);
 	void Welcomed(const QString &user);
+	void BadgeIconURLsLoaded();
 public slots:
+	void LoadBadgeIconURLs();
 	void ParseChatMessage(const QString &prefix,const QString &source,const QStringList &parameters,const QString &message);
 	void DispatchCommand(JSON::SignalPayload *response,const QString &name,const QString &login);
 	void Ping();
@@ -1,6 +1,9 @@
 #include <QCoreApplication>
 #include "channel.h"
 #include "globals.h"
+#include "metrics.h"
+#include "trace.h"
+#include "utf8.h"
 
 const char *OPERATION_CHANNEL="channel";
 const char *OPERATION_CONNECTION="connection";
@@ -89,16 +92,23 @@ Channel::Channel(Security &security,IRCSocket *socket,QObject *parent) : QObject
 	connect(ircSocket,&IRCSocket::readyRead,this,&Channel::DataAvailable);
 	connect(ircSocket,&IRCSocket::errorOccurred,this,&Channel::SocketError);
 	connect(this,&Channel::Ping,this,&Channel::Pong);
+
+	// one recorded line per pass through the event loop, so whatever each line queues up gets to run before the next
+	replayClock.setInterval(0);
+	connect(&replayClock,&QTimer::timeout,this,&Channel::ReplayLine);
 }
 
 Channel::~Channel()
 {
+	if (recording.isOpen()) Network::Record(nullptr);
 	Disconnect();
 }
 
 void Channel::DataAvailable()
 {
 	static QByteArray cache;
+	static Metrics::Counter &lines=Metrics::FindCounter(u"celeste_irc_lines_total"_s,u"IRC lines received"_s);
+	static Metrics::Counter &bytes=Metrics::FindCounter(u"celeste_irc_bytes_total"_s,u"IRC bytes received"_s);
 
 	while (!ircSocket->atEnd())
 	{
@@ -110,15 +120,108 @@ void Channel::DataAvailable()
 		}
 
 		if (cache.isEmpty() || cache.back() != '\n') return;
-		ParseMessage(cache);
+		lines.Increment();
+		bytes.Increment(cache.size());
+		if (recording.isOpen()) recording.write(QByteArray::number(TimeConvert::Now().count())+'\t'+cache);
+		ParseMessage(UTF8::Decode(cache));
 		cache.clear();
 	}
 }
 
+void Channel::Ingest(const QString &line)
+{
+	ParseMessage(line);
+}
+
+bool Channel::Record(const QString &filePath)
+{
+	static const char *OPERATION_RECORD="record session";
+
+	recording.setFileName(filePath);
+	if (!recording.open(QIODevice::WriteOnly|QIODevice::Unbuffered))
+	{
+		emit Print(u"Failed to open session recording (%1): %2"_s.arg(filePath,recording.errorString()),OPERATION_RECORD);
+		return false;
+	}
+	Network::Record([this](const QByteArray &entry) {
+		recording.write(QByteArray::number(TimeConvert::Now().count())+"\t\t"+entry+'\n');
+	});
+	emit Print(u"Recording session to %1"_s.arg(filePath),OPERATION_RECORD);
+	return true;
+}
+
+// each line of a recording is the time a line arrived, in milliseconds since the epoch, a tab, and the line exactly as it came off the socket;
+// a second tab in place of the line marks a network response the session received at that time, which is handed back to whatever asks for it
+bool Channel::Replay(const QString &filePath)
+{
+	static const char *OPERATION_REPLAY="replay session";
+
+	replay.setFileName(filePath);
+	if (!replay.open(QIODevice::ReadOnly))
+	{
+		emit Print(u"Failed to open session recording (%1): %2"_s.arg(filePath,replay.errorString()),OPERATION_REPLAY);
+		return false;
+	}
+	emit Print(u"Replaying session from %1"_s.arg(filePath),OPERATION_REPLAY);
+	replayClock.start();
+	return true;
+}
+
+Clock::TimePoint Channel::RecordingStart(const QString &filePath)
+{
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly)) throw std::runtime_error("Failed to open session recording: "+file.errorString().toStdString());
+	const QByteArray line=file.readLine();
+	bool valid=false;
+	const qint64 arrived=line.left(line.indexOf('\t')).toLongLong(&valid);
+	if (!valid) throw std::runtime_error("Session recording does not start with a timestamp");
+	return Clock::TimePoint(std::chrono::milliseconds(arrived));
+}
+
+void Channel::ReplayLine()
+{
+	static const char *OPERATION_REPLAY="replay session";
+
+	if (replay.atEnd())
+	{
+		replayClock.stop();
+		replay.close();
+		emit Print(u"Replay finished"_s,OPERATION_REPLAY);
+		emit Replayed();
+		return;
+	}
+
+	const QByteArray line=replay.readLine();
+	const qsizetype separator=line.indexOf('\t');
+	if (separator < 0)
+	{
+		emit Print(u"Skipping malformed line in session recording"_s,OPERATION_REPLAY);
+		return;
+	}
+	bool valid=false;
+	const std::chrono::milliseconds arrived(line.left(separator).toLongLong(&valid));
+	if (!valid)
+	{
+		emit Print(u"Skipping line with invalid timestamp in session recording"_s,OPERATION_REPLAY);
+		return;
+	}
+	if (const std::chrono::milliseconds now=TimeConvert::Now(); arrived > now) Clock::Advance(arrived-now);
+	const QByteArray payload=line.mid(separator+1);
+	if (payload.startsWith('\t'))
+		Network::Respond(payload.mid(1).trimmed());
+	else
+		Ingest(UTF8::Decode(payload));
+}
+
 void Channel::ParseMessage(const QString message)
 {
 	static const char* OPERATION_PARSE_MESSAGE="message parsing";
+	static Metrics::Histogram &parseTime=Metrics::FindHistogram(u"celeste_irc_parse_seconds"_s,u"Time spent splitting an IRC line into its parts, before it is dispatched"_s);
+	static Metrics::Histogram &dispatchTime=Metrics::FindHistogram(u"celeste_irc_dispatch_seconds"_s,u"Time spent handling an IRC line once parsed, including anything connected directly to it"_s);
+	Trace::Span span("irc","line");
+	Trace::Correlation::Scope correlation(Trace::Correlation::Begin("irc"));
 	emit Print(message,OPERATION_PARSE_MESSAGE);
+	const std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
 	QStringView window(message);
 
 	// grab prefix if one exists
@@ -135,12 +238,21 @@ void Channel::ParseMessage(const QString message)
 	if (!window.isEmpty()) parameters=StringView::Take(window,':');
 	std::optional<QStringView> finalParameter;
 	if (!window.isEmpty()) finalParameter=StringView::Take(window,'\n');
-	DispatchMessage(prefix ? prefix->toString() : QString(), source ? source->toString() : QString(), command->toString(), parameters ? parameters->toString().split(' ',StringConvert::Split::Behavior(StringConvert::Split::Behaviors::SKIP_EMPTY_PARTS)) : QStringList(), finalParameter ? finalParameter->toString() : QString());
+	QString prefixText=prefix ? prefix->toString() : QString();
+	QString sourceText=source ? source->toString() : QString();
+	QStringList parameterList=parameters ? parameters->toString().split(' ',StringConvert::Split::Behavior(StringConvert::Split::Behaviors::SKIP_EMPTY_PARTS)) : QStringList();
+	QString finalParameterText=finalParameter ? finalParameter->toString() : QString();
+	parseTime.Record(start);
+	Trace::Correlation::Current()->Hop("parsed");
+	const std::chrono::steady_clock::time_point dispatched=std::chrono::steady_clock::now();
+	DispatchMessage(std::move(prefixText),std::move(sourceText),command->toString(),std::move(parameterList),std::move(finalParameterText));
+	dispatchTime.Record(dispatched);
 }
 
 void Channel::DispatchMessage(QString prefix,QString source,QString command,QStringList parameters,QString finalParameter)
 {
 	static const char *OPERATION_DISPATCH="dispatch message";
+	Trace::Span span("irc","dispatch",command);
 
 	bool numeric=false;
 	int code=command.toInt(&numeric);
@@ -165,12 +277,9 @@ void Channel::DispatchMessage(QString prefix,QString source,QString command,QStr
 	case static_cast<int>(IRCCommand::RPL_NAMREPLY):
 	{
 		emit Print(QString("User list received:\n%1").arg(finalParameter.replace(' ','\n')));
-		QStringList rows=finalParameter.split(' ');
-		for (const QString &row : rows)
-		{
-			const QStringList users=row.split('\n'); // Twitch doesn't follow the spec here and returns mutliple names deliminted by \n between each space
-			for (const QString &user : users) emit Joined(user);
-		}
+		// Twitch doesn't follow the spec here and returns mutliple names deliminted by \n between each space, so after
+		// the replace above every name is on its own line and the whole reply goes out as one batch
+		emit Joined(finalParameter.split('\n',Qt::SkipEmptyParts));
 		break;
 	}
 	case static_cast<int>(IRCCommand::RPL_ENDOFNAMES):
@@ -320,14 +429,14 @@ void Channel::DispatchJoin(const QString &source)
 		if (hostmask->nick == static_cast<QString>(security.Administrator()))
 			emit Joined();
 		else
-			emit Joined(hostmask->nick);
+			emit Joined(QStringList{hostmask->nick});
 	}
 }
 
 void Channel::DispatchPart(const QString &source)
 {
 	std::optional<Hostmask> hostmask=ParseSource(source);
-	if (hostmask) emit Parted(hostmask->nick);
+	if (hostmask) emit Parted(QStringList{hostmask->nick});
 }
 
 std::optional<Hostmask> Channel::ParseSource(const QString &source)
@@ -2,6 +2,7 @@
 
 #include <QTcpSocket>
 #include <QTimer>
+#include <QFile>
 #include "settings.h"
 #include "security.h"
 #include "entities.h"
@@ -41,6 +42,10 @@ public:
 	~Channel();
 	void Connect();
 	void Disconnect();
+	void Ingest(const QString &line);
+	bool Record(const QString &filePath);
+	bool Replay(const QString &filePath);
+	static Clock::TimePoint RecordingStart(const QString &filePath);
 	ApplicationSetting& Name();
 	ApplicationSetting& Protection();
 protected:
@@ -48,6 +53,9 @@ protected:
 	ApplicationSetting settingChannel;
 	ApplicationSetting settingProtect;
 	IRCSocket *ircSocket;
+	QFile recording;
+	QFile replay;
+	QTimer replayClock;
 	void ParseMessage(const QString message);
 	void DispatchMessage(QString prefix,QString source,QString command,QStringList parameters,QString finalParamter);
 	void SendMessage(QString prefix,QString command,QStringList parameters,QString finalParamter);
@@ -68,11 +76,13 @@ signals:
 	void Disconnected();
 	void Denied();
 	void Joined();
-	void Joined(const QString &user);
-	void Parted(const QString &user);
+	void Joined(const QStringList &users);
+	void Parted(const QStringList &users);
 	void Ping(const QString &token);
+	void Replayed();
 protected slots:
 	void DataAvailable();
 	void SocketError(QAbstractSocket::SocketError error);
 	void Pong(const QString &token);
+	void ReplayLine();
 };
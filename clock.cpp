@@ -0,0 +1,109 @@
+#include <vector>
+#include <algorithm>
+#include "clock.h"
+
+namespace Clock
+{
+	static std::vector<Timer*>& Timers()
+	{
+		static std::vector<Timer*> timers;
+		return timers;
+	}
+
+	void Simulate(TimePoint start)
+	{
+		simulated=true;
+		simulatedTime=start;
+	}
+
+	void Advance(std::chrono::milliseconds amount)
+	{
+		if (!simulated) return;
+		const TimePoint target=simulatedTime+amount;
+		while (true)
+		{
+			// timers can start and stop each other from inside Timeout, so look again after every one fires
+			Timer *next=nullptr;
+			for (Timer *timer : Timers())
+			{
+				if (timer->due && *timer->due <= target && (!next || *timer->due < *next->due)) next=timer;
+			}
+			if (!next) break;
+
+			simulatedTime=*next->due;
+			if (next->singleShot)
+				next->due.reset();
+			else
+				next->due=simulatedTime+std::max(next->interval,std::chrono::milliseconds(1)); // a zero interval would otherwise never let time move
+			emit next->Timeout();
+		}
+		simulatedTime=target;
+	}
+
+	std::chrono::milliseconds Settle(std::chrono::milliseconds limit)
+	{
+		if (!simulated) return std::chrono::milliseconds(0);
+		const TimePoint start=simulatedTime;
+		const TimePoint deadline=start+limit;
+		while (true)
+		{
+			// repeating timers never stop being due, so only the single-shot ones (batches, cooldowns, retries) are waited on
+			std::optional<TimePoint> next;
+			for (Timer *timer : Timers())
+			{
+				if (timer->singleShot && timer->due && (!next || *timer->due < *next)) next=timer->due;
+			}
+			if (!next || *next > deadline) break;
+			Advance(std::chrono::ceil<std::chrono::milliseconds>(*next-simulatedTime));
+		}
+		return std::chrono::duration_cast<std::chrono::milliseconds>(simulatedTime-start);
+	}
+
+	Timer::Timer(QObject *parent) : QObject(parent), interval(0), singleShot(false)
+	{
+		connect(&timer,&QTimer::timeout,this,&Timer::Timeout);
+		Timers().push_back(this);
+	}
+
+	Timer::~Timer()
+	{
+		std::erase(Timers(),this);
+	}
+
+	void Timer::Interval(std::chrono::milliseconds interval)
+	{
+		this->interval=interval;
+		timer.setInterval(interval);
+	}
+
+	void Timer::SingleShot(bool singleShot)
+	{
+		this->singleShot=singleShot;
+		timer.setSingleShot(singleShot);
+	}
+
+	bool Timer::Active() const
+	{
+		return simulated ? due.has_value() : timer.isActive();
+	}
+
+	void Timer::Start()
+	{
+		if (simulated)
+			due=Now()+interval;
+		else
+			timer.start();
+	}
+
+	void Timer::Start(std::chrono::milliseconds interval)
+	{
+		Interval(interval);
+		Start();
+	}
+
+	void Timer::Stop()
+	{
+		due.reset();
+		timer.stop();
+	}
+}
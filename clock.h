@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QObject>
+#include <QTimer>
+#include <QDateTime>
+#include <chrono>
+#include <optional>
+
+// wall clock time for everything the bot decides on (cooldowns, raids, uptime, timers); a simulation swaps in
+// virtual time that only moves when it's told to, so replaying a recorded session plays out the same way every time
+namespace Clock
+{
+	using TimePoint=std::chrono::system_clock::time_point;
+
+	inline bool simulated=false; // only touched from the GUI thread
+	inline TimePoint simulatedTime;
+
+	inline TimePoint Now() { return simulated ? simulatedTime : std::chrono::system_clock::now(); }
+	inline QDateTime Current() { return QDateTime::fromMSecsSinceEpoch(std::chrono::duration_cast<std::chrono::milliseconds>(Now().time_since_epoch()).count()); }
+	void Simulate(TimePoint start); // must be called before any timers start
+	void Advance(std::chrono::milliseconds amount); // fires every simulated timer that comes due along the way, in order
+	std::chrono::milliseconds Settle(std::chrono::milliseconds limit); // advances until no single-shot timer is waiting (or limit runs out), returning how far
+
+	// stands in for QTimer, and in a simulation fires off of virtual time instead
+	class Timer : public QObject
+	{
+		Q_OBJECT
+	public:
+		Timer(QObject *parent=nullptr);
+		~Timer();
+		void Interval(std::chrono::milliseconds interval);
+		std::chrono::milliseconds Interval() const { return interval; }
+		void SingleShot(bool singleShot);
+		bool Active() const;
+		void Start();
+		void Start(std::chrono::milliseconds interval);
+		void Stop();
+	protected:
+		QTimer timer;
+		std::chrono::milliseconds interval;
+		bool singleShot;
+		std::optional<TimePoint> due;
+		friend void Advance(std::chrono::milliseconds amount);
+		friend std::chrono::milliseconds Settle(std::chrono::milliseconds limit);
+	signals:
+		void Timeout();
+	};
+}
@@ -6,6 +6,7 @@
 #include <cstring>
 #include "entities.h"
 #include "globals.h"
+#include "imaging.h"
 #include "twitch.h"
 
 Q_DECLARE_METATYPE(std::chrono::milliseconds)
@@ -581,7 +582,7 @@ namespace Music
 				quint32 length=DataSize();
 				QByteArray data=file.read(length);
 				if (data.size() < length) throw std::runtime_error("Invalid image data in frame of mp3 file");
-				picture=QImage::fromData(data);
+				picture=Imaging::Decode(data,Imaging::DisplaySize());
 			}
 
 			const QImage& APIC::Picture() const
@@ -643,10 +644,17 @@ namespace Viewer
 		{
 			Network::Request(profileImageURL,Network::Method::GET,[this](QNetworkReply *reply) {
 				if (reply->error())
+				{
 					emit Print(QString("Failed: %1").arg(reply->errorString()),"profile image retrieval");
-				else
-					emit Retrieved(std::make_shared<QImage>(QImage::fromData(reply->readAll())));
-				this->deleteLater();
+					this->deleteLater();
+					return;
+				}
+				Imaging::Decoder *decoder=new Imaging::Decoder(reply->readAll(),Imaging::DisplaySize());
+				connect(decoder,&Imaging::Decoder::Print,this,&Remote::Print);
+				connect(decoder,&Imaging::Decoder::Decoded,this,[this](const QImage &image) {
+					emit Retrieved(std::make_shared<QImage>(image));
+					this->deleteLater();
+				});
 			});
 		}
 
@@ -12,6 +12,7 @@
 #include <memory>
 #include "settings.h"
 #include "security.h"
+#include "trace.h"
 
 enum class CommandType
 {
@@ -341,7 +342,7 @@ namespace Chat
 		QString name;
 		QString id;
 		QString path;
-		unsigned int start { 0 };
+		unsigned int start { 0 }; // Twitch sends codepoints, but by the time a message leaves the bot these are UTF-16 indices into its text
 		unsigned int end { 0 };
 		bool operator<(const Emote &other) const { return start < other.start; }
 	};
@@ -356,6 +357,7 @@ namespace Chat
 		bool action { false };
 		bool broadcaster { false };
 		bool moderator { false };
+		bool html { false }; // text is markup to render as is rather than plain text
 		bool Privileged() const { return broadcaster || moderator; }
 	};
 }
@@ -366,10 +368,11 @@ namespace JSON
 	{
 		Q_OBJECT
 	public:
-		SignalPayload(const QJsonObject &payload) : QObject(nullptr), payload(payload) { }
+		SignalPayload(const QJsonObject &payload) : QObject(nullptr), payload(payload), correlation(Trace::Correlation::Current()) { }
 		void Dispatch();
 		QJsonObject payload;
 		QVariant context;
+		std::shared_ptr<Trace::Correlation> correlation; // the event that raised it, since payloads cross a queued connection
 	signals:
 		void Deliver(const QJsonObject &payload);
 	};
@@ -3,12 +3,17 @@
 #include <QJsonArray>
 #include <QStringBuilder>
 #include <QUuid>
+#include <QDateTime>
 #include "globals.h"
 #include "twitch.h"
 #include "eventsub.h"
+#include "metrics.h"
+#include "trace.h"
 
 const char *JSON_KEY_METADATA="metadata";
 const char *JSON_KEY_METADATA_TYPE="message_type";
+const char *JSON_KEY_METADATA_TIMESTAMP="message_timestamp";
+const char *JSON_KEY_METADATA_SUBSCRIPTION_TYPE="subscription_type";
 const char *JSON_KEY_PAYLOAD="payload";
 const char *JSON_KEY_PAYLOAD_SESSION="session";
 const char *JSON_KEY_PAYLOAD_SESSION_ID="id";
@@ -50,6 +55,9 @@ enum class TwitchCloseCode
 
 EventSub::EventSub(Security &security,QObject *parent) : QObject(parent),
 	security(security),
+	outstandingSubscriptions(0),
+	unauthorized(false),
+	rateLimited(false),
 	settingURL(SETTINGS_CATEGORY_EVENTS,"WebsocketURL","wss://eventsub.wss.twitch.tv/ws")
 {
 	messageTypes.insert({MESSAGE_TYPE_WELCOME,MessageType::WELCOME});
@@ -123,15 +131,21 @@ void EventSub::Dead()
 
 void EventSub::Subscribe()
 {
-	defaultTypes.push(SUBSCRIPTION_TYPE_REDEMPTION);
-	defaultTypes.push(SUBSCRIPTION_TYPE_RAID);
-	defaultTypes.push(SUBSCRIPTION_TYPE_SUBSCRIPTION);
-	defaultTypes.push(SUBSCRIPTION_TYPE_RESUBSCRIPTION);
-	defaultTypes.push(SUBSCRIPTION_TYPE_CHEER);
-	defaultTypes.push(SUBSCRIPTION_TYPE_HYPE_TRAIN_START);
-	defaultTypes.push(SUBSCRIPTION_TYPE_HYPE_TRAIN_PROGRESS);
-	defaultTypes.push(SUBSCRIPTION_TYPE_HYPE_TRAIN_END);
-	Subscribe(defaultTypes.front());
+	// the requests don't depend on each other, so they all go out at once instead of waiting on the previous response
+	static const char *DEFAULT_TYPES[]={
+		SUBSCRIPTION_TYPE_REDEMPTION,
+		SUBSCRIPTION_TYPE_RAID,
+		SUBSCRIPTION_TYPE_SUBSCRIPTION,
+		SUBSCRIPTION_TYPE_RESUBSCRIPTION,
+		SUBSCRIPTION_TYPE_CHEER,
+		SUBSCRIPTION_TYPE_HYPE_TRAIN_START,
+		SUBSCRIPTION_TYPE_HYPE_TRAIN_PROGRESS,
+		SUBSCRIPTION_TYPE_HYPE_TRAIN_END
+	};
+	unauthorized=false;
+	rateLimited=false;
+	outstandingSubscriptions+=std::size(DEFAULT_TYPES);
+	for (const char *type : DEFAULT_TYPES) Subscribe(type);
 }
 
 void EventSub::Subscribe(const QString &type)
@@ -141,29 +155,36 @@ void EventSub::Subscribe(const QString &type)
 	emit Print(u"Requesting subscription to %1"_s.arg(type),TWITCH_API_OPERATION_SUBSCRIBE);
 	Network::Request({Twitch::Endpoint(Twitch::ENDPOINT_EVENTSUB)},Network::Method::POST,[this,type](QNetworkReply *reply) {
 		emit Print(StringConvert::Dump(reply->readAll()),TWITCH_API_OPERATION_SUBSCRIBE);
+		SubscriptionAnswered();
 		switch (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt())
 		{
 		case 202:
 			emit Print(u"Successfully subscribed to %1"_s.arg(type),TWITCH_API_OPERATION_SUBSCRIBE);
-			NextSubscription();
 			return;
 		case 400:
 			emit Print(u"The subscription request was malformatted"_s,TWITCH_API_OPERATION_SUBSCRIBE);
 			break;
 		case 401:
 			emit Print(u"Invalid OAuth token or authorization header was malformatted"_s,TWITCH_API_OPERATION_SUBSCRIBE);
-			emit Unauthorized();
+			if (!unauthorized)
+			{
+				unauthorized=true;
+				emit Unauthorized();
+			}
 			return;
 		case 403:
 			emit Print(u"Access token is missing the required scopes"_s,TWITCH_API_OPERATION_SUBSCRIBE);
 			break;
 		case 409:
 			emit Print(u"Subscription already exists"_s,TWITCH_API_OPERATION_SUBSCRIBE);
-			NextSubscription();
 			return;
 		case 429:
 			emit Print(u"Too many subscription requests"_s,TWITCH_API_OPERATION_SUBSCRIBE);
-			emit RateLimitHit();
+			if (!rateLimited)
+			{
+				rateLimited=true;
+				emit RateLimitHit();
+			}
 			return;
 		}
 		emit EventSubscriptionFailed(type);
@@ -188,20 +209,18 @@ void EventSub::Subscribe(const QString &type)
 	})).toJson(QJsonDocument::Compact));
 }
 
-void EventSub::NextSubscription()
+void EventSub::SubscriptionAnswered()
 {
-	if (!defaultTypes.empty())
-	{
-		defaultTypes.pop();
-		if (!defaultTypes.empty()) Subscribe(defaultTypes.front());
-	}
+	if (outstandingSubscriptions == 0) return;
+	if (--outstandingSubscriptions == 0) emit Subscribed();
 }
 
 void EventSub::ParseMessage(QString message)
 {
 	static const char *OPERATION_PARSE_MESSAGE="parse message";
+	Trace::Span span("eventsub","message");
 
-	const JSON::ParseResult parsedJSON=JSON::Parse(StringConvert::ByteArray(message.trimmed()));
+	const JSON::ParseResult parsedJSON=JSON::Parse(message.trimmed().toUtf8()); // the socket already decoded the frame, so this is the only conversion, and it can't lose anything
 
 	if (!parsedJSON)
 	{
@@ -241,6 +260,12 @@ void EventSub::ParseMessage(QString message)
 		keepalive.start();
 		break;
 	case MessageType::NOTIFICATION:
+		if (const QDateTime sent=QDateTime::fromString(metadataObject.value(JSON_KEY_METADATA_TIMESTAMP).toString(),Qt::ISODateWithMs); sent.isValid())
+		{
+			Metrics::FindHistogram(u"celeste_eventsub_lag_seconds"_s,u"Time between Twitch sending an EventSub notification and Celeste receiving it"_s,{
+				{u"type"_s,metadataObject.value(JSON_KEY_METADATA_SUBSCRIPTION_TYPE).toString()}
+			}).Record(std::chrono::milliseconds(sent.msecsTo(QDateTime::currentDateTimeUtc())));
+		}
 		ParseNotification(payload->toObject());
 		break;
 	default:
@@ -278,9 +303,31 @@ void EventSub::ParseWelcome(QJsonObject payload)
 	}
 }
 
+static const char* CorrelationType(SubscriptionType subscriptionType)
+{
+	switch (subscriptionType)
+	{
+	case SubscriptionType::CHANNEL_FOLLOW:
+		return "follow";
+	case SubscriptionType::CHANNEL_REDEMPTION:
+		return "redemption";
+	case SubscriptionType::CHANNEL_CHEER:
+		return "cheer";
+	case SubscriptionType::CHANNEL_RAID:
+		return "raid";
+	case SubscriptionType::CHANNEL_SUBSCRIPTION:
+		return "subscription";
+	case SubscriptionType::CHANNEL_HYPE_TRAIN:
+		return "hype train";
+	default:
+		return "eventsub";
+	}
+}
+
 void EventSub::ParseNotification(QJsonObject notification)
 {
 	static const char *OPERATION_PARSE_NOTIFICATION="parse notification";
+	Trace::Span span("eventsub","notification",notification.value(JSON_KEY_PAYLOAD_SUBSCRIPTION).toObject().value(JSON_KEY_PAYLOAD_SUBSCRIPTION_TYPE).toString());
 
 	auto subscription=notification.find(JSON_KEY_PAYLOAD_SUBSCRIPTION);
 	if (subscription == notification.end())
@@ -300,6 +347,7 @@ void EventSub::ParseNotification(QJsonObject notification)
 		}
 	}
 	if (subscriptionType == SubscriptionType::UNKNOWN) return;
+	Trace::Correlation::Scope correlation(Trace::Correlation::Begin(CorrelationType(subscriptionType)));
 
 	auto event=notification.find(JSON_KEY_EVENT);
 	if (event == notification.end())
@@ -359,7 +407,7 @@ void EventSub::RequestEventSubscriptionList()
 		const QByteArray data=reply->readAll();
 		emit Print(StringConvert::Dump(data),TWITCH_API_OPERATION_SUBSCRIPTION_LIST);
 
-		const JSON::ParseResult parsedJSON=JSON::Parse(StringConvert::ByteArray(data.trimmed()));
+		const JSON::ParseResult parsedJSON=JSON::Parse(data.trimmed()); // straight from the reply's UTF-8
 		if (!parsedJSON)
 		{
 			Print(QString("Invalid JSON: %1").arg(parsedJSON.error),TWITCH_API_OPERATION_SUBSCRIPTION_LIST);
@@ -3,7 +3,6 @@
 #include <QDateTime>
 #include <QWebSocket>
 #include <QJsonObject>
-#include <queue>
 #include "settings.h"
 #include "security.h"
 #include "entities.h"
@@ -50,14 +49,16 @@ protected:
 	QString buffer;
 	MessageTypes messageTypes;
 	SubscriptionTypes subscriptionTypes; // TODO: find a better name for this
-	std::queue<QString> defaultTypes;
+	unsigned int outstandingSubscriptions;
+	bool unauthorized;
+	bool rateLimited;
 	QWebSocket socket;
 	QString sessionID;
 	QTimer keepalive;
 	ApplicationSetting settingURL;
 	static const char *SETTINGS_CATEGORY_EVENTS; // TODO: can this be removed later when I switch to modules (linking conflicts with definition in bot.cpp)
 	void Connect();
-	void NextSubscription();
+	void SubscriptionAnswered();
 	const QByteArray ProcessRequest(const SubscriptionType type,const QString &data);
 	const QString BuildResponse(const QString &data=QString()) const;
 	std::optional<QString> ExtractPrompt(SubscriptionType type,const QJsonObject &event) const;
@@ -76,6 +77,7 @@ signals:
 	void EventSubscriptionRemoved(const QString &id);
 	void ParseCommand(JSON::SignalPayload *payload,const QString &name,const QString &login);
 	void Connected();
+	void Subscribed();
 	void Disconnected();
 protected slots:
 	void ParseMessage(QString message);
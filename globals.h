@@ -17,6 +17,10 @@
 #include <functional>
 #include <queue>
 #include <stdexcept>
+#include <atomic>
+#include <limits>
+#include <bit>
+#include "clock.h"
 
 using namespace Qt::Literals::StringLiterals;
 
@@ -122,22 +126,6 @@ namespace StringConvert
 		return QString("> (data)");
 #endif
 	}
-
-	inline int RestrictFontWidth(QFont font,const QString &text,int maxPixels)
-	{
-		int originalPointSize=font.pointSize();
-		QFontMetrics metrics{font};
-		QRect bounds=metrics.boundingRect(text);
-		while (bounds.width() > maxPixels)
-		{
-			int reducedPointSize=font.pointSize()-1;
-			if (reducedPointSize < 1) return originalPointSize;
-			font.setPointSize(reducedPointSize);
-			metrics=QFontMetrics{font};
-			bounds=metrics.boundingRect(text);
-		}
-		return font.pointSize();
-	}
 }
 
 namespace TimeConvert
@@ -147,7 +135,7 @@ namespace TimeConvert
 	constexpr int Interval(const std::chrono::seconds &value) { return value.count(); }
 	constexpr int Interval(const std::chrono::milliseconds &value) { return value.count(); }
 	constexpr std::chrono::seconds OneSecond() { return static_cast<std::chrono::seconds>(1); }
-	inline const std::chrono::milliseconds Now() { return std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::system_clock::now()).time_since_epoch(); }
+	inline const std::chrono::milliseconds Now() { return std::chrono::time_point_cast<std::chrono::milliseconds>(Clock::Now()).time_since_epoch(); }
 }
 
 namespace StringView
@@ -216,12 +204,67 @@ namespace Filesystem
 
 namespace Random
 {
-	inline std::random_device generator;
+	// xoshiro256** (https://prng.di.unimi.it/), seeded through splitmix64 so any 64-bit seed fills the state well
+	class Engine
+	{
+	public:
+		using result_type=quint64;
+		Engine(quint64 seed) { Seed(seed); }
+		void Seed(quint64 seed)
+		{
+			for (quint64 &word : state)
+			{
+				seed+=0x9e3779b97f4a7c15;
+				quint64 mixed=seed;
+				mixed=(mixed^(mixed >> 30))*0xbf58476d1ce4e5b9;
+				mixed=(mixed^(mixed >> 27))*0x94d049bb133111eb;
+				word=mixed^(mixed >> 31);
+			}
+		}
+		result_type operator()()
+		{
+			const quint64 result=std::rotl(state[1]*5,7)*9;
+			const quint64 shifted=state[1] << 17;
+			state[2]^=state[0];
+			state[3]^=state[1];
+			state[1]^=state[2];
+			state[0]^=state[3];
+			state[2]^=shifted;
+			state[3]=std::rotl(state[3],45);
+			return result;
+		}
+		static constexpr result_type min() { return std::numeric_limits<result_type>::min(); }
+		static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+	protected:
+		quint64 state[4];
+	};
+
+	inline std::atomic<quint64> seed { 0 }; // zero means draw one from the system
+	inline std::atomic<quint64> streams { 0 };
+
+	// one per thread so drawing never locks; with a fixed seed, each thread gets its own stream off of it in the order threads first draw
+	inline Engine& Generator()
+	{
+		thread_local Engine generator([]() -> quint64 {
+			if (const quint64 fixed=seed.load(std::memory_order_relaxed); fixed != 0) return fixed+streams.fetch_add(1,std::memory_order_relaxed);
+			std::random_device device;
+			return (static_cast<quint64>(device()) << 32)|device();
+		}());
+		return generator;
+	}
+
+	// the calling thread starts over from exactly this seed, which makes a simulation repeatable
+	inline void Seed(quint64 value)
+	{
+		seed.store(value,std::memory_order_relaxed);
+		streams.store(1,std::memory_order_relaxed);
+		Generator().Seed(value);
+	}
 
 	inline int Bounded(int lower,int upper)
 	{
 		std::uniform_int_distribution<int> distribution(lower,upper);
-		return distribution(generator);
+		return distribution(Generator());
 	}
 
 	template<Concept::Container T> inline int Bounded(const T &container)
@@ -233,7 +276,7 @@ namespace Random
 
 	template<Concept::Container T> inline void Shuffle(T &container)
 	{
-		std::shuffle(container.begin(),container.end(),generator);
+		std::shuffle(container.begin(),container.end(),Generator());
 	}
 }
 
@@ -256,8 +299,6 @@ namespace Network
 	inline const char *CONTENT_TYPE_JSON="application/json";
 	inline const char *CONTENT_TYPE_FORM="application/x-www-form-urlencoded";
 
-	static QNetworkAccessManager networkManager;
-
 	enum class Method
 	{
 		GET,
@@ -267,50 +308,13 @@ namespace Network
 	};
 
 	using Reply=std::function<void(QNetworkReply*)>;
-	static std::queue<std::pair<std::function<void()>,Reply>> queue;
+	using Recorder=std::function<void(const QByteArray &entry)>;
 
-	inline void Request(QUrl url,Method method,Reply callback,const QUrlQuery &queryParameters=QUrlQuery(),const std::vector<std::pair<QByteArray,QByteArray>> &headers=std::vector<std::pair<QByteArray,QByteArray>>(),const QByteArray &payload=QByteArray())
-	{
-		networkManager.connect(&networkManager,&QNetworkAccessManager::finished,&networkManager,[](QNetworkReply *reply) {
-			reply->deleteLater();
-		},Qt::QueuedConnection);
-
-		QNetworkRequest request;
-		for (const std::pair<QByteArray,QByteArray> &header : headers) request.setRawHeader(header.first,header.second);
-		switch (method)
-		{
-		case Method::GET:
-		{
-			url.setQuery(queryParameters);
-			request.setUrl(url);
-			auto sendRequest=[request,callback]() {
-				QNetworkReply *reply=networkManager.get(request);
-				networkManager.connect(&networkManager,&QNetworkAccessManager::finished,reply,callback,Qt::QueuedConnection);
-				reply->connect(reply,&QNetworkReply::finished,reply,[]() {
-					queue.pop();
-					if (queue.size() > 0) queue.front().first();
-				},Qt::QueuedConnection);
-			};
-			if (queue.size() == 0) sendRequest();
-			queue.push({sendRequest,callback});
-			break;
-		}
-		case Method::POST:
-			request.setUrl(url);
-			networkManager.connect(&networkManager,&QNetworkAccessManager::finished,networkManager.post(request,payload.isEmpty() ? StringConvert::ByteArray(queryParameters.query()) : payload),callback,Qt::QueuedConnection);
-			break;
-		case Method::PATCH:
-			url.setQuery(queryParameters);
-			request.setUrl(url);
-			networkManager.connect(&networkManager,&QNetworkAccessManager::finished,networkManager.sendCustomRequest(request,"PATCH"_ba,payload),callback,Qt::QueuedConnection);
-			break;
-		case Method::DELETE:
-			url.setQuery(queryParameters);
-			request.setUrl(url);
-			networkManager.connect(&networkManager,&QNetworkAccessManager::finished,networkManager.sendCustomRequest(request,"DELETE"_ba,payload),callback,Qt::QueuedConnection);
-			break;
-		}
-	}
+	void Request(QUrl url,Method method,Reply callback,const QUrlQuery &queryParameters=QUrlQuery(),const std::vector<std::pair<QByteArray,QByteArray>> &headers=std::vector<std::pair<QByteArray,QByteArray>>(),const QByteArray &payload=QByteArray());
+	void CachePolicy(const QString &prefix,std::chrono::seconds lifetime);
+	void Record(Recorder recorder); // hands every response a caller receives to recorder as one line of text, until it's cleared
+	void Simulate(); // requests stop going out and wait for the matching recorded response to be passed to Respond
+	void Respond(const QByteArray &entry);
 }
 
 namespace JSON
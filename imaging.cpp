@@ -0,0 +1,59 @@
+#include <QBuffer>
+#include <QImageReader>
+#include <QPixmapCache>
+#include <QThreadPool>
+#include "imaging.h"
+#include "globals.h"
+
+namespace Imaging
+{
+	static QSize displaySize;
+
+	const QSize& DisplaySize()
+	{
+		return displaySize;
+	}
+
+	void DisplaySize(const QSize &size)
+	{
+		displaySize=size;
+	}
+
+	// formats that support scaled reads (JPEG) never allocate the full-size image; images that already fit
+	// are left alone, since scaling them up would only cost memory and sharpness
+	QImage Decode(const QByteArray &data,const QSize &size)
+	{
+		QBuffer buffer;
+		buffer.setData(data);
+		if (!buffer.open(QIODevice::ReadOnly)) return {};
+		QImageReader reader(&buffer);
+		if (const QSize source=reader.size(); size.isValid() && source.isValid() && (source.width() > size.width() || source.height() > size.height())) reader.setScaledSize(source.scaled(size,Qt::KeepAspectRatio));
+		return reader.read();
+	}
+
+	QPixmap Pixmap(const QImage &image,const QSize &size)
+	{
+		const QString key=u"imaging:%1:%2x%3"_s.arg(QString::number(image.cacheKey()),StringConvert::Integer(size.width()),StringConvert::Integer(size.height()));
+		QPixmap pixmap;
+		if (QPixmapCache::find(key,&pixmap)) return pixmap;
+		pixmap=QPixmap::fromImage(image.size() == size ? image : image.scaled(size,Qt::IgnoreAspectRatio,Qt::SmoothTransformation));
+		QPixmapCache::insert(key,pixmap);
+		return pixmap;
+	}
+
+	Decoder::Decoder(const QByteArray &data,const QSize &size,const QString &destination) : QObject(nullptr)
+	{
+		QThreadPool::globalInstance()->start([this,data,size,destination]() {
+			const QImage image=Decode(data,size);
+			const bool saved=!image.isNull() && (destination.isEmpty() || image.save(destination));
+			QMetaObject::invokeMethod(this,[this,image,saved,destination]() {
+				if (image.isNull())
+					emit Print(u"Failed to decode image data"_s,u"decode image"_s);
+				else if (!saved)
+					emit Print(u"Failed to save image to %1"_s.arg(destination),u"save image"_s);
+				emit Decoded(image);
+				deleteLater();
+			},Qt::QueuedConnection);
+		});
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QObject>
+#include <QImage>
+#include <QPixmap>
+#include <QSize>
+
+namespace Imaging
+{
+	const QSize& DisplaySize();
+	void DisplaySize(const QSize &size);
+	QImage Decode(const QByteArray &data,const QSize &size=QSize());
+	QPixmap Pixmap(const QImage &image,const QSize &size);
+
+	class Decoder : public QObject
+	{
+		Q_OBJECT
+	public:
+		Decoder(const QByteArray &data,const QSize &size,const QString &destination=QString());
+	signals:
+		void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("image decoder"));
+		void Decoded(const QImage &image);
+	};
+}
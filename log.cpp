@@ -1,5 +1,6 @@
 #include <QDate>
 #include "log.h"
+#include "metrics.h"
 
 const char *SETTINGS_CATEGORY_LOGGING="Logging";
 
@@ -48,18 +49,22 @@ void Log::Close()
 
 void Log::Write(const Entry &entry)
 {
+	static Metrics::Gauge &depth=Metrics::FindGauge(u"celeste_log_queue_depth"_s,u"Log entries held back because they couldn't be written to the log file yet"_s);
 	emit Print(entry);
 	hold.push(entry);
-	if (!file.isOpen()) return;
-	while (!hold.empty())
+	if (file.isOpen())
 	{
-		if (file.write(hold.front()) < 0 || !file.flush())
+		while (!hold.empty())
 		{
-			hold.push({"Failed","write to log file"});
-			return;
+			if (file.write(hold.front()) < 0 || !file.flush())
+			{
+				hold.push({"Failed","write to log file"});
+				break;
+			}
+			hold.pop();
 		}
-		hold.pop();
 	}
+	depth.Set(hold.size());
 }
 
 void Log::Receive(const QString &message,const QString &operation,const QString &subsystem)
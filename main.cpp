@@ -8,6 +8,7 @@
 #include <QListWidget>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QCommandLineParser>
 #include <exception>
 #include "window.h"
 #include "widgets.h"
@@ -18,10 +19,16 @@
 #include "globals.h"
 #include "security.h"
 #include "pulsar.h"
+#include "startup.h"
+#include "snapshot.h"
+#include "metrics.h"
+#include "watchdog.h"
+#include "presence.h"
 
 const char *ORGANIZATION_NAME="EngineeringDeck";
 const char *APPLICATION_NAME="Celeste";
 const char *SUBSYSTEM_AUTHORIZATION="authorization";
+const std::chrono::milliseconds REPLAY_SETTLE_LIMIT=std::chrono::hours(1);
 
 enum
 {
@@ -173,6 +180,29 @@ int main(int argc,char *argv[])
 	application.setApplicationName(APPLICATION_NAME);
 	if constexpr (!Platform::Windows()) application.setWindowIcon(QIcon(Resources::CELESTE));
 
+	// a replay runs on virtual time with a fixed seed, so the same recording plays out identically every time
+	QCommandLineParser arguments;
+	const QCommandLineOption seedOption(u"seed"_s,u"Seed the random number generator with <value> instead of a random seed."_s,u"value"_s);
+	const QCommandLineOption recordOption(u"record"_s,u"Record every IRC line received to <file>."_s,u"file"_s);
+	const QCommandLineOption replayOption(u"replay"_s,u"Replay a recorded session from <file> on virtual time instead of connecting to Twitch."_s,u"file"_s);
+	arguments.addHelpOption();
+	arguments.addOptions({seedOption,recordOption,replayOption});
+	arguments.process(application);
+	if (arguments.isSet(seedOption))
+	{
+		// zero is how the generator spells "unseeded", so it can't be passed through as a seed
+		bool valid=false;
+		const quint64 seed=arguments.value(seedOption).toULongLong(&valid);
+		if (!valid || seed == 0)
+		{
+			MessageBox(u"Invalid Seed"_s,u"The seed must be a whole number greater than zero, not \"%1\"."_s.arg(arguments.value(seedOption)),QMessageBox::Critical,QMessageBox::Ok,QMessageBox::Ok);
+			return FATAL_ERROR;
+		}
+		Random::Seed(seed);
+	}
+	const QString recordPath=arguments.value(recordOption);
+	const QString replayPath=arguments.value(replayOption);
+
 #ifdef DEVELOPER_MODE
 	if (MessageBox(u"DEVELOPER MODE"_s,u"**WARNING** Celeste is currently in developer mode. Sensitive data will be displayed in the main window and written to the log. Only proceed if you know what you are doing. Continue?"_s,QMessageBox::Warning,QMessageBox::Yes|QMessageBox::No,QMessageBox::No) == QMessageBox::No) return OK;
 #endif
@@ -205,22 +235,37 @@ int main(int argc,char *argv[])
 
 	try
 	{
+		if (!replayPath.isEmpty())
+		{
+			Clock::Simulate(Channel::RecordingStart(replayPath)); // before anything starts a timer
+			Network::Simulate(); // or makes a request
+		}
+		Startup startup;
 		Log log;
+		Snapshot snapshot;
 		IRCSocket socket;
 		Channel *channel=new Channel(security,&socket);
 		Music::Player musicPlayer(true,0);
-		Bot celeste(musicPlayer,security);
-		const Command::Lookup &botCommands=celeste.DeserializeCommands(celeste.LoadDynamicCommands());
-		const File::List &musicPlaylist=celeste.SetVibePlaylist(celeste.DeserializeVibePlaylist(celeste.LoadVibePlaylist()));
+		snapshot.connect(&snapshot,&Snapshot::Print,&log,&Log::Receive);
+		snapshot.Open();
+		Presence presence;
+		Bot celeste(musicPlayer,security,snapshot,presence);
+		const Command::Lookup &botCommands=celeste.Commands();
+		const File::List &musicPlaylist=musicPlayer.Sources();
 		Pulsar pulsar;
 		EventSub *eventSub=nullptr;
 		ApplicationWindow window;
 		UI::Metrics::Dialog metrics(&window);
+		Metrics::Endpoint metricsEndpoint;
+		Watchdog watchdog;
 
 		security.connect(&security,&Security::TokenRequestFailed,[&application]() {
 			MessageBox(u"Authentication Failed"_s,u"Attempt to obtain OAuth token failed."_s,QMessageBox::Warning,QMessageBox::Ok,QMessageBox::Ok);
 			application.exit(AUTHENTICATION_ERROR);
 		});
+		startup.connect(&startup,&Startup::Print,&log,&Log::Receive);
+		metricsEndpoint.connect(&metricsEndpoint,&Metrics::Endpoint::Print,&log,&Log::Receive);
+		watchdog.connect(&watchdog,&Watchdog::Print,&log,&Log::Receive);
 		QMetaObject::Connection echo=log.connect(&log,&Log::Print,&window,QOverload<const QString&>::of(&Window::Print));
 		celeste.connect(&celeste,&Bot::ChatMessage,&window,&Window::ChatMessage);
 		celeste.connect(&celeste,&Bot::RefreshChat,&window,&Window::RefreshChat);
@@ -252,11 +297,16 @@ int main(int argc,char *argv[])
 			celeste.disconnect();
 		});
 		pulsar.connect(&pulsar,&Pulsar::Print,&log,&Log::Receive);
+		pulsar.connect(&pulsar,&Pulsar::Report,&log,&Log::Receive);
 		channel->connect(channel,&Channel::Print,&log,&Log::Receive);
 		channel->connect(channel,&Channel::Dispatch,&celeste,&Bot::ParseChatMessage);
+		channel->connect(channel,&Channel::Dispatch,&startup,&Startup::MessageHandled,Qt::SingleShotConnection); // after the bot, so this measures a handled message
 		channel->connect(channel,&Channel::Ping,&celeste,&Bot::Ping);
-		channel->connect(channel,QOverload<const QString&>::of(&Channel::Joined),&metrics,&UI::Metrics::Dialog::Joined);
-		channel->connect(channel,QOverload<const QString&>::of(&Channel::Parted),&metrics,&UI::Metrics::Dialog::Parted);
+		channel->connect(channel,QOverload<const QStringList&>::of(&Channel::Joined),&presence,&Presence::Join);
+		channel->connect(channel,&Channel::Parted,&presence,&Presence::Part);
+		channel->connect(channel,&Channel::Disconnected,&presence,&Presence::Clear);
+		presence.connect(&presence,&Presence::Arrived,&metrics,&UI::Metrics::Dialog::Joined);
+		presence.connect(&presence,&Presence::Departed,&metrics,&UI::Metrics::Dialog::Parted);
 		channel->connect(channel,QOverload<>::of(&Channel::Joined),&window,&Window::ShowChat);
 		channel->connect(channel,QOverload<>::of(&Channel::Joined),[&echo,&log,&celeste,&pulsar,&window]() {
 			log.disconnect(echo);
@@ -271,9 +321,10 @@ int main(int argc,char *argv[])
 			if (MessageBox(u"Connection Failed"_s,u"Failed to connect to Twitch. Would you like to try again?"_s,QMessageBox::Question,QMessageBox::Yes|QMessageBox::No,QMessageBox::Yes) == QMessageBox::No) return;
 			channel->Connect();
 		});
-		channel->connect(channel,&Channel::Connected,[&security,&window,channel,&celeste,&log,&application,eventSub]() mutable {
+		auto startEventSub=[&security,&window,&celeste,&log,&application,&eventSub,&startup]() {
 			if (eventSub) eventSub->deleteLater();
 			eventSub=new EventSub(security);
+			startup.FinishOn(u"eventsub"_s,eventSub,&EventSub::Subscribed);
 
 			eventSub->connect(eventSub,&EventSub::Print,&log,&Log::Receive);
 			eventSub->connect(eventSub,&EventSub::Redemption,&celeste,&Bot::Redemption);
@@ -290,14 +341,19 @@ int main(int argc,char *argv[])
 				MessageBox(u"EventSub Rate Limit"_s,u"The maximum number of subscription requests has been hit. EventSub functionality may be limited."_s,QMessageBox::Information,QMessageBox::Ok,QMessageBox::Ok);
 			},Qt::QueuedConnection);
 			eventSub->connect(eventSub,&EventSub::Connected,eventSub,QOverload<>::of(&EventSub::Subscribe),Qt::QueuedConnection);
-			window.connect(&window,&Window::ConfigureEventSubscriptions,[&window,eventSub]() {
+			window.connect(&window,&Window::ConfigureEventSubscriptions,eventSub,[&window,eventSub]() {
 				ShowEventSubscriptions(window,eventSub);
 			});
 			celeste.connect(&celeste,&Bot::Panic,eventSub,&EventSub::deleteLater,Qt::QueuedConnection);
 			application.connect(&application,&QApplication::aboutToQuit,eventSub,&EventSub::deleteLater,Qt::DirectConnection);
+		};
+		channel->connect(channel,&Channel::Connected,[&eventSub,startEventSub,reconnecting=false]() mutable {
+			// the first session is started by the startup graph alongside IRC, reconnects start a fresh one here, as
+			// long as the eventsub stage has gotten far enough to create one (whether or not it has subscribed yet)
+			if (reconnecting && eventSub) startEventSub();
+			reconnecting=true;
 		});
 		channel->connect(channel,&Channel::Denied,&security,&Security::AuthorizeUser);
-		security.connect(&security,&Security::Initialized,channel,&Channel::Connect);
 		application.connect(&application,&QApplication::aboutToQuit,[&log,&socket,channel]() {
 			socket.connect(&socket,&IRCSocket::disconnected,&log,&Log::Archive);
 			channel->disconnect(); // stops attempting to reconnect by removing all connections to signals
@@ -325,9 +381,39 @@ int main(int argc,char *argv[])
 		});
 
 		if (!log.Open()) MessageBox(u"Error Opening Log"_s,u"Failed to open log file. Log messages will not be saved to filesystem"_s,QMessageBox::Critical,QMessageBox::Ok,QMessageBox::Ok);
-		pulsar.LoadTriggers();
-		window.show();
-		security.Listen();
+
+		// security goes first so its network round trips are in flight while local files load, except in a replay, which
+		// answers every request from the recording and so never signs in
+		if (replayPath.isEmpty())
+		{
+			if (!recordPath.isEmpty()) channel->Record(recordPath); // before the first request, so the recording has every response
+			startup.Stage(u"security"_s,{},[&security]() { security.Listen(); });
+			startup.FinishOn(u"security"_s,&security,&Security::Initialized);
+		}
+		startup.Task(u"window"_s,{},[&window]() { window.show(); });
+		startup.Task(u"commands"_s,{},[&celeste]() { celeste.DeserializeCommands(celeste.LoadDynamicCommands()); });
+		startup.Task(u"playlist"_s,{},[&celeste]() { celeste.SetVibePlaylist(celeste.DeserializeVibePlaylist(celeste.LoadVibePlaylist())); });
+		startup.Task(u"pulsar"_s,{},[&pulsar]() { pulsar.LoadTriggers(); });
+		startup.Task(u"metrics"_s,{},[&metricsEndpoint]() { metricsEndpoint.Listen(); });
+		startup.Task(u"watchdog"_s,{},[&watchdog]() { watchdog.Start(); });
+		startup.Stage(u"badges"_s,replayPath.isEmpty() ? QStringList{u"security"_s} : QStringList{},[&celeste]() { celeste.LoadBadgeIconURLs(); });
+		startup.FinishOn(u"badges"_s,&celeste,&Bot::BadgeIconURLsLoaded);
+		if (replayPath.isEmpty())
+		{
+			startup.Stage(u"irc"_s,{u"security"_s},[channel]() { channel->Connect(); });
+			startup.FinishOn(u"irc"_s,channel,QOverload<>::of(&Channel::Joined));
+			startup.Stage(u"eventsub"_s,{u"security"_s},startEventSub);
+		}
+		else
+		{
+			startup.Task(u"replay"_s,{},[channel,replayPath]() { channel->Replay(replayPath); });
+			channel->connect(channel,&Channel::Replayed,&window,[&window]() {
+				// nothing arrives after the last line to move virtual time along, so run it forward until whatever was still waiting on it has fired
+				const std::chrono::milliseconds settled=Clock::Settle(REPLAY_SETTLE_LIMIT);
+				emit window.Print(u"Advanced %1 seconds past the end of the replay for pending timers"_s.arg(TimeConvert::Seconds(settled).count()),u"replay session"_s,u"clock"_s);
+			});
+		}
+		startup.Start();
 
 		return application.exec();
 	}
@@ -0,0 +1,263 @@
+#include <QTcpSocket>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <bit>
+#include <cmath>
+#include "metrics.h"
+#include "globals.h"
+
+const char *METRICS_CONTENT_TYPE="text/plain; version=0.0.4; charset=utf-8";
+const int METRICS_EXPOSED_EXPONENT_FIRST=4; // 16 microseconds
+const int METRICS_EXPOSED_EXPONENT_LAST=34; // a little under five hours
+
+namespace Metrics
+{
+	const char *Counter::TYPE="counter";
+	const char *Gauge::TYPE="gauge";
+	const char *Histogram::TYPE="histogram";
+
+	struct Family
+	{
+		QString help;
+		const char *type;
+		std::map<QString,std::unique_ptr<Metric>> series; // keyed by the rendered label set
+	};
+
+	static std::mutex& Lock()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	static std::map<QString,Family>& Families()
+	{
+		static std::map<QString,Family> families;
+		return families;
+	}
+
+	static QString RenderLabels(const Labels &labels)
+	{
+		QStringList pairs;
+		for (const std::pair<QString,QString> &label : labels)
+		{
+			QString value=label.second;
+			value.replace(u"\\"_s,u"\\\\"_s).replace(u"\""_s,u"\\\""_s).replace(u"\n"_s,u"\\n"_s);
+			pairs.append(u"%1=\"%2\""_s.arg(label.first,value));
+		}
+		return pairs.join(',');
+	}
+
+	static QString Series(const QString &name,const QString &labels)
+	{
+		return labels.isEmpty() ? name : u"%1{%2}"_s.arg(name,labels);
+	}
+
+	static QString Duration(quint64 microseconds)
+	{
+		if (microseconds < 1000) return u"%1 µs"_s.arg(microseconds);
+		if (microseconds < 1000000) return u"%1 ms"_s.arg(static_cast<double>(microseconds)/1000.0,0,'f',1);
+		return u"%1 s"_s.arg(static_cast<double>(microseconds)/1000000.0,0,'f',2);
+	}
+
+	template <typename T> static T& Find(const QString &name,const QString &help,const Labels &labels)
+	{
+		const QString key=RenderLabels(labels);
+		std::lock_guard<std::mutex> lock(Lock());
+		Family &family=Families().try_emplace(name,Family{.help=help,.type=T::TYPE,.series={}}).first->second;
+		if (family.type != T::TYPE) throw std::logic_error("Metric was registered with two different types: "+name.toStdString());
+		std::unique_ptr<Metric> &series=family.series[key];
+		if (!series) series=std::make_unique<T>();
+		return static_cast<T&>(*series);
+	}
+
+	Counter& FindCounter(const QString &name,const QString &help,const Labels &labels)
+	{
+		return Find<Counter>(name,help,labels);
+	}
+
+	Gauge& FindGauge(const QString &name,const QString &help,const Labels &labels)
+	{
+		return Find<Gauge>(name,help,labels);
+	}
+
+	Histogram& FindHistogram(const QString &name,const QString &help,const Labels &labels)
+	{
+		return Find<Histogram>(name,help,labels);
+	}
+
+	QByteArray Exposition()
+	{
+		QString output;
+		std::lock_guard<std::mutex> lock(Lock());
+		for (const std::pair<const QString,Family> &family : Families())
+		{
+			output.append(u"# HELP %1 %2\n# TYPE %1 %3\n"_s.arg(family.first,family.second.help,family.second.type));
+			for (const std::pair<const QString,std::unique_ptr<Metric>> &series : family.second.series) series.second->Expose(output,family.first,series.first);
+		}
+		return output.toUtf8();
+	}
+
+	std::vector<Reading> Readings()
+	{
+		std::vector<Reading> readings;
+		std::lock_guard<std::mutex> lock(Lock());
+		for (const std::pair<const QString,Family> &family : Families())
+		{
+			for (const std::pair<const QString,std::unique_ptr<Metric>> &series : family.second.series)
+			{
+				readings.push_back({
+					.name=family.first,
+					.labels=series.first,
+					.value=series.second->Describe()
+				});
+			}
+		}
+		return readings;
+	}
+
+	void Counter::Expose(QString &output,const QString &name,const QString &labels) const
+	{
+		output.append(u"%1 %2\n"_s.arg(Series(name,labels),QString::number(Value())));
+	}
+
+	QString Counter::Describe() const
+	{
+		return QString::number(Value());
+	}
+
+	void Gauge::Expose(QString &output,const QString &name,const QString &labels) const
+	{
+		output.append(u"%1 %2\n"_s.arg(Series(name,labels),QString::number(Value())));
+	}
+
+	QString Gauge::Describe() const
+	{
+		return QString::number(Value());
+	}
+
+	int Histogram::Bucket(quint64 value)
+	{
+		if (value < SUB_BUCKETS) return static_cast<int>(value);
+		const int exponent=std::bit_width(value)-1;
+		const int shift=exponent-SUB_BUCKET_BITS;
+		return (shift+1)*SUB_BUCKETS+static_cast<int>((value >> shift)-SUB_BUCKETS);
+	}
+
+	quint64 Histogram::LowerBound(int bucket)
+	{
+		if (bucket < SUB_BUCKETS) return bucket;
+		const int group=bucket/SUB_BUCKETS;
+		return static_cast<quint64>(SUB_BUCKETS+bucket%SUB_BUCKETS) << (group-1);
+	}
+
+	quint64 Histogram::UpperBound(int bucket)
+	{
+		if (bucket < SUB_BUCKETS) return bucket+1;
+		if (bucket == BUCKETS-1) return std::numeric_limits<quint64>::max();
+		return LowerBound(bucket)+(static_cast<quint64>(1) << (bucket/SUB_BUCKETS-1));
+	}
+
+	void Histogram::Record(quint64 microseconds)
+	{
+		buckets[Bucket(microseconds)].fetch_add(1,std::memory_order_relaxed);
+		count.fetch_add(1,std::memory_order_relaxed);
+		sum.fetch_add(microseconds,std::memory_order_relaxed);
+	}
+
+	quint64 Histogram::Quantile(double quantile) const
+	{
+		std::array<quint64,BUCKETS> counts;
+		quint64 total=0;
+		for (int bucket=0; bucket < BUCKETS; bucket++) total+=counts[bucket]=buckets[bucket].load(std::memory_order_relaxed);
+		if (total == 0) return 0;
+
+		const quint64 target=std::max<quint64>(1,static_cast<quint64>(std::ceil(quantile*static_cast<double>(total))));
+		quint64 seen=0;
+		for (int bucket=0; bucket < BUCKETS; bucket++)
+		{
+			seen+=counts[bucket];
+			if (seen >= target) return LowerBound(bucket)+(UpperBound(bucket)-LowerBound(bucket))/2;
+		}
+		return LowerBound(BUCKETS-1);
+	}
+
+	void Histogram::Expose(QString &output,const QString &name,const QString &labels) const
+	{
+		// only the power of two boundaries are exported, which line up exactly with the buckets underneath them
+		const QString prefix=labels.isEmpty() ? QString() : labels+u","_s;
+		quint64 cumulative=0;
+		int bucket=0;
+		for (int exponent=METRICS_EXPOSED_EXPONENT_FIRST; exponent <= METRICS_EXPOSED_EXPONENT_LAST; exponent++)
+		{
+			const quint64 boundary=static_cast<quint64>(1) << exponent;
+			for (; bucket < BUCKETS && UpperBound(bucket) <= boundary; bucket++) cumulative+=buckets[bucket].load(std::memory_order_relaxed);
+			output.append(u"%1_bucket{%2le=\"%3\"} %4\n"_s.arg(name,prefix,QString::number(static_cast<double>(boundary)/1000000.0,'g',12),QString::number(cumulative)));
+		}
+		for (; bucket < BUCKETS; bucket++) cumulative+=buckets[bucket].load(std::memory_order_relaxed);
+		output.append(u"%1_bucket{%2le=\"+Inf\"} %3\n"_s.arg(name,prefix,QString::number(cumulative)));
+		output.append(u"%1 %2\n"_s.arg(Series(name+u"_sum"_s,labels),QString::number(static_cast<double>(sum.load(std::memory_order_relaxed))/1000000.0,'g',12)));
+		output.append(u"%1 %2\n"_s.arg(Series(name+u"_count"_s,labels),QString::number(cumulative)));
+	}
+
+	QString Histogram::Describe() const
+	{
+		const quint64 samples=Count();
+		if (samples == 0) return u"no samples"_s;
+		return u"%1 samples, p50 %2, p99 %3, mean %4"_s.arg(QString::number(samples),Duration(Quantile(0.5)),Duration(Quantile(0.99)),Duration(sum.load(std::memory_order_relaxed)/samples));
+	}
+
+	const QString Endpoint::SETTINGS_CATEGORY="Metrics";
+
+	Endpoint::Endpoint(QObject *parent) : QObject(parent),
+		settingPort(SETTINGS_CATEGORY,"Port",9464) // 0 turns the endpoint off
+	{
+		connect(&server,&QTcpServer::newConnection,this,&Endpoint::Connection);
+	}
+
+	bool Endpoint::Listen()
+	{
+		static const char *OPERATION="listen";
+
+		const quint16 port=settingPort;
+		if (port == 0)
+		{
+			emit Print(u"Metrics endpoint is disabled"_s,OPERATION);
+			return false;
+		}
+		if (!server.listen(QHostAddress::LocalHost,port))
+		{
+			emit Print(u"Failed to serve metrics on port %1: %2"_s.arg(StringConvert::PositiveInteger(port),server.errorString()),OPERATION);
+			return false;
+		}
+		emit Print(u"Serving metrics at http://127.0.0.1:%1/metrics"_s.arg(StringConvert::PositiveInteger(port)),OPERATION);
+		return true;
+	}
+
+	void Endpoint::Connection()
+	{
+		while (QTcpSocket *socket=server.nextPendingConnection())
+		{
+			connect(socket,&QTcpSocket::disconnected,socket,&QTcpSocket::deleteLater);
+			connect(socket,&QTcpSocket::readyRead,socket,[socket]() {
+				// the request line is all that matters, headers are ignored
+				if (!socket->canReadLine()) return;
+				QObject::disconnect(socket,&QTcpSocket::readyRead,socket,nullptr);
+				const QList<QByteArray> request=socket->readLine().trimmed().split(' ');
+				const bool found=request.size() >= 2 && request.at(0) == "GET" && (request.at(1) == "/metrics" || request.at(1) == "/");
+				const QByteArray body=found ? Exposition() : QByteArray("Not found\n");
+				socket->write(QByteArray(found ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n")
+					+Network::CONTENT_TYPE+": "+(found ? METRICS_CONTENT_TYPE : Network::CONTENT_TYPE_PLAIN)+"\r\n"
+					+"Content-Length: "+QByteArray::number(body.size())+"\r\n"
+					+"Connection: close\r\n\r\n"
+					+body);
+				socket->disconnectFromHost();
+			});
+		}
+	}
+
+	ApplicationSetting& Endpoint::Port()
+	{
+		return settingPort;
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QTcpServer>
+#include <atomic>
+#include <array>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "settings.h"
+
+// counters, gauges, and histograms are updated with relaxed atomics and never removed once registered,
+// so hot paths can look one up once, keep the reference, and record from any thread without locking
+namespace Metrics
+{
+	using Labels=std::vector<std::pair<QString,QString>>;
+
+	struct Reading
+	{
+		QString name;
+		QString labels;
+		QString value;
+	};
+
+	class Metric
+	{
+	public:
+		virtual ~Metric() { }
+		virtual void Expose(QString &output,const QString &name,const QString &labels) const=0;
+		virtual QString Describe() const=0;
+	};
+
+	class Counter : public Metric
+	{
+	public:
+		static const char *TYPE;
+		void Increment(quint64 amount=1) { value.fetch_add(amount,std::memory_order_relaxed); }
+		quint64 Value() const { return value.load(std::memory_order_relaxed); }
+		void Expose(QString &output,const QString &name,const QString &labels) const override;
+		QString Describe() const override;
+	protected:
+		std::atomic<quint64> value { 0 };
+	};
+
+	class Gauge : public Metric
+	{
+	public:
+		static const char *TYPE;
+		void Set(qint64 amount) { value.store(amount,std::memory_order_relaxed); }
+		void Add(qint64 amount) { value.fetch_add(amount,std::memory_order_relaxed); }
+		qint64 Value() const { return value.load(std::memory_order_relaxed); }
+		void Expose(QString &output,const QString &name,const QString &labels) const override;
+		QString Describe() const override;
+	protected:
+		std::atomic<qint64> value { 0 };
+	};
+
+	// log-linear buckets in microseconds: each power of two is split into 2^SUB_BUCKET_BITS equal steps,
+	// which keeps the error of any quantile under 1/2^SUB_BUCKET_BITS no matter how large the value
+	class Histogram : public Metric
+	{
+	public:
+		static const char *TYPE;
+		static constexpr int SUB_BUCKET_BITS=3;
+		static constexpr int SUB_BUCKETS=1 << SUB_BUCKET_BITS;
+		static constexpr int BUCKETS=(64-SUB_BUCKET_BITS+1)*SUB_BUCKETS;
+		void Record(quint64 microseconds);
+		void Record(std::chrono::microseconds duration) { Record(static_cast<quint64>(std::max<qint64>(duration.count(),0))); }
+		void Record(std::chrono::steady_clock::time_point start) { Record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-start)); }
+		quint64 Count() const { return count.load(std::memory_order_relaxed); }
+		quint64 Quantile(double quantile) const;
+		void Expose(QString &output,const QString &name,const QString &labels) const override;
+		QString Describe() const override;
+		static int Bucket(quint64 value);
+		static quint64 LowerBound(int bucket);
+		static quint64 UpperBound(int bucket);
+	protected:
+		std::array<std::atomic<quint64>,BUCKETS> buckets {};
+		std::atomic<quint64> count { 0 };
+		std::atomic<quint64> sum { 0 };
+	};
+
+	Counter& FindCounter(const QString &name,const QString &help,const Labels &labels=Labels());
+	Gauge& FindGauge(const QString &name,const QString &help,const Labels &labels=Labels());
+	Histogram& FindHistogram(const QString &name,const QString &help,const Labels &labels=Labels());
+	QByteArray Exposition();
+	std::vector<Reading> Readings();
+
+	// serves the text exposition format on the loopback interface for Prometheus or anything else that can scrape it
+	class Endpoint : public QObject
+	{
+		Q_OBJECT
+	public:
+		Endpoint(QObject *parent=nullptr);
+		bool Listen();
+		ApplicationSetting& Port();
+	protected:
+		QTcpServer server;
+		ApplicationSetting settingPort;
+		static const QString SETTINGS_CATEGORY;
+	signals:
+		void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("metrics"));
+	protected slots:
+		void Connection();
+	};
+}
@@ -0,0 +1,443 @@
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QTimer>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QCborMap>
+#include <QCborArray>
+#include <QCborValue>
+#include <unordered_map>
+#include <queue>
+#include <cstring>
+#include "globals.h"
+#include "metrics.h"
+#include "trace.h"
+
+const char *NETWORK_CACHE_FILENAME="network.cache";
+const char *NETWORK_CACHE_KEY_VERSION="version";
+const char *NETWORK_CACHE_KEY_ENTRIES="entries";
+const char *NETWORK_CACHE_KEY_URL="url";
+const char *NETWORK_CACHE_KEY_STATUS="status";
+const char *NETWORK_CACHE_KEY_CONTENT_TYPE="type";
+const char *NETWORK_CACHE_KEY_ETAG="etag";
+const char *NETWORK_CACHE_KEY_LAST_MODIFIED="modified";
+const char *NETWORK_CACHE_KEY_BODY="body";
+const char *NETWORK_CACHE_KEY_STORED="stored";
+const char *NETWORK_RECORD_KEY_ERROR="error";
+const char *NETWORK_RECORD_EXCLUDED_HOST="id.twitch.tv"; // OAuth answers carry tokens, which don't belong in a recording (and nothing a replay runs asks for them)
+const char *NETWORK_HEADER_ETAG="ETag";
+const char *NETWORK_HEADER_LAST_MODIFIED="Last-Modified";
+const char *NETWORK_HEADER_IF_NONE_MATCH="If-None-Match";
+const char *NETWORK_HEADER_IF_MODIFIED_SINCE="If-Modified-Since";
+const qint64 NETWORK_CACHE_VERSION=1;
+const size_t NETWORK_CACHE_CAPACITY=1024;
+const std::chrono::milliseconds NETWORK_CACHE_SAVE_DELAY=std::chrono::seconds(5);
+
+namespace Network
+{
+	struct CacheEntry
+	{
+		int status;
+		QByteArray contentType;
+		QByteArray etag;
+		QByteArray lastModified;
+		QByteArray body;
+		qint64 stored; // last time the server vouched for the body, in milliseconds since the epoch
+	};
+
+	// stands in for a network reply so callbacks can't tell a cached or recorded response from a live one
+	class CachedReply : public QNetworkReply
+	{
+	public:
+		CachedReply(const QNetworkRequest &request,const CacheEntry &entry,QObject *parent,QNetworkReply::NetworkError error=QNetworkReply::NoError) : QNetworkReply(parent), body(entry.body), offset(0)
+		{
+			setRequest(request);
+			setUrl(request.url());
+			setOperation(QNetworkAccessManager::GetOperation);
+			setAttribute(QNetworkRequest::HttpStatusCodeAttribute,entry.status);
+			setAttribute(QNetworkRequest::SourceIsFromCacheAttribute,true);
+			if (!entry.contentType.isEmpty()) setRawHeader(CONTENT_TYPE,entry.contentType);
+			if (error != QNetworkReply::NoError) setError(error,u"Recorded network error"_s);
+			open(QIODevice::ReadOnly|QIODevice::Unbuffered);
+			setFinished(true);
+			QMetaObject::invokeMethod(this,[this]() {
+				emit readyRead();
+				emit finished();
+			},Qt::QueuedConnection);
+		}
+		void abort() override { }
+		qint64 bytesAvailable() const override { return body.size()-offset+QNetworkReply::bytesAvailable(); }
+		bool isSequential() const override { return true; }
+	protected:
+		QByteArray body;
+		qint64 offset;
+		qint64 readData(char *data,qint64 maxSize) override
+		{
+			const qint64 count=std::min(maxSize,static_cast<qint64>(body.size())-offset);
+			if (count <= 0) return -1;
+			std::memcpy(data,body.constData()+offset,count);
+			offset+=count;
+			return count;
+		}
+	};
+
+	static std::queue<std::pair<std::function<void()>,Reply>> queue;
+	static std::unordered_map<QString,CacheEntry> cacheEntries;
+	static std::vector<std::pair<QString,std::chrono::seconds>> cachePolicies;
+	static bool cacheLoaded=false;
+	static Recorder recorder;
+	static bool simulated=false;
+	static std::unordered_map<QString,std::queue<std::pair<QNetworkRequest,Reply>>> awaiting; // requests made during a replay, until their recorded response is reached
+	static std::unordered_map<QString,std::queue<std::pair<CacheEntry,QNetworkReply::NetworkError>>> recorded; // recorded responses reached before anything asked for them
+
+	static QNetworkAccessManager& Manager()
+	{
+		static QNetworkAccessManager manager;
+		return manager;
+	}
+
+	static QString CacheFilePath()
+	{
+		return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath(NETWORK_CACHE_FILENAME);
+	}
+
+	static void SaveCache()
+	{
+		QCborArray entries;
+		for (const std::pair<const QString,CacheEntry> &entry : cacheEntries)
+		{
+			entries.append(QCborMap{
+				{NETWORK_CACHE_KEY_URL,entry.first},
+				{NETWORK_CACHE_KEY_STATUS,entry.second.status},
+				{NETWORK_CACHE_KEY_CONTENT_TYPE,entry.second.contentType},
+				{NETWORK_CACHE_KEY_ETAG,entry.second.etag},
+				{NETWORK_CACHE_KEY_LAST_MODIFIED,entry.second.lastModified},
+				{NETWORK_CACHE_KEY_BODY,entry.second.body},
+				{NETWORK_CACHE_KEY_STORED,entry.second.stored}
+			});
+		}
+
+		const QString filePath=CacheFilePath();
+		if (!QDir().mkpath(QFileInfo(filePath).absolutePath())) return;
+		QSaveFile file(filePath);
+		if (!file.open(QIODevice::WriteOnly)) return;
+		file.write(QCborValue(QCborMap{
+			{NETWORK_CACHE_KEY_VERSION,NETWORK_CACHE_VERSION},
+			{NETWORK_CACHE_KEY_ENTRIES,entries}
+		}).toCbor());
+		file.commit();
+	}
+
+	static void ScheduleSave()
+	{
+		static QTimer *saveClock=nullptr;
+		if (!saveClock)
+		{
+			saveClock=new QTimer(&Manager());
+			saveClock->setSingleShot(true);
+			saveClock->setInterval(TimeConvert::Interval(NETWORK_CACHE_SAVE_DELAY));
+			saveClock->connect(saveClock,&QTimer::timeout,&SaveCache);
+			QObject::connect(qApp,&QCoreApplication::aboutToQuit,saveClock,[]() {
+				if (saveClock->isActive()) SaveCache();
+			});
+		}
+		saveClock->start();
+	}
+
+	static void LoadCache()
+	{
+		if (cacheLoaded) return;
+		cacheLoaded=true;
+
+		QFile file(CacheFilePath());
+		if (!file.open(QIODevice::ReadOnly)) return;
+		const QCborMap root=QCborValue::fromCbor(file.readAll()).toMap();
+		if (root.value(NETWORK_CACHE_KEY_VERSION).toInteger() != NETWORK_CACHE_VERSION) return;
+		const QCborArray entries=root.value(NETWORK_CACHE_KEY_ENTRIES).toArray();
+		for (const QCborValue &value : entries)
+		{
+			const QCborMap entry=value.toMap();
+			cacheEntries.insert_or_assign(entry.value(NETWORK_CACHE_KEY_URL).toString(),CacheEntry{
+				.status=static_cast<int>(entry.value(NETWORK_CACHE_KEY_STATUS).toInteger()),
+				.contentType=entry.value(NETWORK_CACHE_KEY_CONTENT_TYPE).toByteArray(),
+				.etag=entry.value(NETWORK_CACHE_KEY_ETAG).toByteArray(),
+				.lastModified=entry.value(NETWORK_CACHE_KEY_LAST_MODIFIED).toByteArray(),
+				.body=entry.value(NETWORK_CACHE_KEY_BODY).toByteArray(),
+				.stored=entry.value(NETWORK_CACHE_KEY_STORED).toInteger()
+			});
+		}
+	}
+
+	static void Evict()
+	{
+		while (cacheEntries.size() > NETWORK_CACHE_CAPACITY)
+		{
+			auto oldest=std::min_element(cacheEntries.begin(),cacheEntries.end(),[](const std::pair<const QString,CacheEntry> &left,const std::pair<const QString,CacheEntry> &right) {
+				return left.second.stored < right.second.stored;
+			});
+			cacheEntries.erase(oldest);
+		}
+	}
+
+	static std::optional<std::chrono::seconds> Policy(const QString &url)
+	{
+		// the longest matching prefix wins, so a specific endpoint can override its host
+		std::optional<std::chrono::seconds> result;
+		qsizetype length=-1;
+		for (const std::pair<QString,std::chrono::seconds> &policy : cachePolicies)
+		{
+			if (policy.first.size() > length && url.startsWith(policy.first))
+			{
+				result=policy.second;
+				length=policy.first.size();
+			}
+		}
+		return result;
+	}
+
+	static void Count(const char *result)
+	{
+		Metrics::FindCounter(u"celeste_http_cache_total"_s,u"Cacheable GET requests by how the cache answered them"_s,{{u"result"_s,result}}).Increment();
+	}
+
+	// host and the first two path segments, which tells Helix endpoints apart without putting IDs from CDN paths in a label
+	static QString Endpoint(const QUrl &url)
+	{
+		const QStringList segments=url.path().split('/',StringConvert::Split::Behavior(StringConvert::Split::Behaviors::SKIP_EMPTY_PARTS));
+		return url.host()+'/'+segments.mid(0,2).join('/');
+	}
+
+	static void Observe(QNetworkReply *reply,const char *method)
+	{
+		const std::chrono::steady_clock::time_point sent=std::chrono::steady_clock::now();
+		reply->connect(reply,&QNetworkReply::finished,reply,[reply,method,sent]() {
+			const QVariant status=reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+			const QString endpoint=Endpoint(reply->url());
+			Trace::Complete("network",method,sent,endpoint);
+			Metrics::FindHistogram(u"celeste_http_request_seconds"_s,u"Time from sending a request to its response finishing"_s,{
+				{u"endpoint"_s,endpoint},
+				{u"method"_s,method},
+				{u"status"_s,status.isValid() ? status.toString() : u"error"_s}
+			}).Record(sent);
+		});
+	}
+
+	static void Deliver(QNetworkReply *reply,const Reply &callback)
+	{
+		// tied to this reply specifically, so the callback only ever sees its own response
+		reply->connect(reply,&QNetworkReply::finished,reply,[reply,callback]() {
+			callback(reply);
+			reply->deleteLater();
+		},Qt::QueuedConnection);
+	}
+
+	// wraps the caller's callback so the response is stored, or the stored body is reused on a 304, before the caller reads it
+	static Reply Cache(const QString &key,const QNetworkRequest &request,const Reply &callback)
+	{
+		return [key,request,callback](QNetworkReply *reply) {
+			const int status=reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+			auto candidate=cacheEntries.find(key);
+			if (status == 304 && candidate != cacheEntries.end())
+			{
+				Count("revalidated");
+				candidate->second.stored=QDateTime::currentMSecsSinceEpoch();
+			}
+			else
+			{
+				Count("miss");
+				if (reply->error() != QNetworkReply::NoError || status != 200)
+				{
+					callback(reply);
+					return;
+				}
+				candidate=cacheEntries.insert_or_assign(key,CacheEntry{
+					.status=status,
+					.contentType=reply->rawHeader(CONTENT_TYPE),
+					.etag=reply->rawHeader(NETWORK_HEADER_ETAG),
+					.lastModified=reply->rawHeader(NETWORK_HEADER_LAST_MODIFIED),
+					.body=reply->readAll(),
+					.stored=QDateTime::currentMSecsSinceEpoch()
+				}).first;
+				Evict();
+				candidate=cacheEntries.find(key);
+			}
+			ScheduleSave();
+
+			CachedReply *cached=new CachedReply(request,candidate->second,&Manager());
+			callback(cached);
+			cached->deleteLater();
+		};
+	}
+
+	// the method is part of what a response answers, so a GET and a DELETE of the same URL don't trade responses in a replay
+	static QString RecordKey(Method method,const QString &url)
+	{
+		return StringConvert::Integer(static_cast<int>(method))+' '+url;
+	}
+
+	// writes down what the caller is about to see (from the network or the cache alike), then hands it over as a copy
+	// because reading the body for the recording uses it up
+	static Reply Record(const QString &key,const QNetworkRequest &request,const Reply &callback)
+	{
+		return [key,request,callback](QNetworkReply *reply) {
+			const QNetworkReply::NetworkError error=reply->error();
+			const CacheEntry entry{
+				.status=reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(),
+				.contentType=reply->rawHeader(CONTENT_TYPE),
+				.etag={},
+				.lastModified={},
+				.body=reply->readAll(),
+				.stored=0
+			};
+			if (recorder)
+			{
+				recorder(QCborValue(QCborMap{
+					{NETWORK_CACHE_KEY_URL,key},
+					{NETWORK_CACHE_KEY_STATUS,entry.status},
+					{NETWORK_RECORD_KEY_ERROR,static_cast<int>(error)},
+					{NETWORK_CACHE_KEY_CONTENT_TYPE,entry.contentType},
+					{NETWORK_CACHE_KEY_BODY,entry.body}
+				}).toCbor().toBase64());
+			}
+
+			CachedReply *copy=new CachedReply(request,entry,&Manager(),error);
+			callback(copy);
+			copy->deleteLater();
+		};
+	}
+
+	// pairs requests with recorded responses in the order each was made, whichever side turns up first
+	static void Await(const QString &key,const QNetworkRequest &request,const Reply &callback)
+	{
+		if (auto candidate=recorded.find(key); candidate != recorded.end() && !candidate->second.empty())
+		{
+			Deliver(new CachedReply(request,candidate->second.front().first,&Manager(),candidate->second.front().second),callback);
+			candidate->second.pop();
+			return;
+		}
+		awaiting[key].push({request,callback});
+	}
+
+	void Record(Recorder recorder)
+	{
+		Network::recorder=std::move(recorder);
+	}
+
+	void Simulate()
+	{
+		simulated=true;
+	}
+
+	void Respond(const QByteArray &entry)
+	{
+		const QCborMap fields=QCborValue::fromCbor(QByteArray::fromBase64(entry)).toMap();
+		const QString key=fields.value(NETWORK_CACHE_KEY_URL).toString();
+		std::pair<CacheEntry,QNetworkReply::NetworkError> response{
+			CacheEntry{
+				.status=static_cast<int>(fields.value(NETWORK_CACHE_KEY_STATUS).toInteger()),
+				.contentType=fields.value(NETWORK_CACHE_KEY_CONTENT_TYPE).toByteArray(),
+				.etag={},
+				.lastModified={},
+				.body=fields.value(NETWORK_CACHE_KEY_BODY).toByteArray(),
+				.stored=0
+			},
+			static_cast<QNetworkReply::NetworkError>(fields.value(NETWORK_RECORD_KEY_ERROR).toInteger())
+		};
+
+		if (auto candidate=awaiting.find(key); candidate != awaiting.end() && !candidate->second.empty())
+		{
+			Deliver(new CachedReply(candidate->second.front().first,response.first,&Manager(),response.second),candidate->second.front().second);
+			candidate->second.pop();
+			return;
+		}
+		recorded[key].push(std::move(response));
+	}
+
+	void CachePolicy(const QString &prefix,std::chrono::seconds lifetime)
+	{
+		cachePolicies.emplace_back(prefix,lifetime);
+	}
+
+	void Request(QUrl url,Method method,Reply callback,const QUrlQuery &queryParameters,const std::vector<std::pair<QByteArray,QByteArray>> &headers,const QByteArray &payload)
+	{
+		// the response comes back on a later pass of the event loop, so whatever event asked for it is carried along to the callback
+		if (std::shared_ptr<Trace::Correlation> correlation=Trace::Correlation::Current(); correlation)
+		{
+			callback=[correlation,callback](QNetworkReply *reply) {
+				Trace::Correlation::Scope scope(correlation,"network response");
+				callback(reply);
+			};
+		}
+
+		if (method != Method::POST) url.setQuery(queryParameters);
+		QNetworkRequest request(url);
+		for (const std::pair<QByteArray,QByteArray> &header : headers) request.setRawHeader(header.first,header.second);
+		const QString key=url.toString(QUrl::FullyEncoded);
+
+		// a replay gets exactly what the recorded session got, bypassing the cache, which changes from run to run
+		if (simulated)
+		{
+			Await(RecordKey(method,key),request,callback);
+			return;
+		}
+		if (recorder && url.host() != NETWORK_RECORD_EXCLUDED_HOST) callback=Record(RecordKey(method,key),request,callback);
+
+		switch (method)
+		{
+		case Method::GET:
+		{
+			// only endpoints with a policy are cached, and only ones whose response doesn't depend on who's asking should get one
+			if (std::optional<std::chrono::seconds> lifetime=Policy(key); lifetime)
+			{
+				LoadCache();
+				if (auto candidate=cacheEntries.find(key); candidate != cacheEntries.end())
+				{
+					if (QDateTime::currentMSecsSinceEpoch()-candidate->second.stored < TimeConvert::Milliseconds(*lifetime).count())
+					{
+						Count("hit");
+						Deliver(new CachedReply(request,candidate->second,&Manager()),callback);
+						return;
+					}
+					if (!candidate->second.etag.isEmpty()) request.setRawHeader(NETWORK_HEADER_IF_NONE_MATCH,candidate->second.etag);
+					if (!candidate->second.lastModified.isEmpty()) request.setRawHeader(NETWORK_HEADER_IF_MODIFIED_SINCE,candidate->second.lastModified);
+				}
+				callback=Cache(key,request,callback);
+			}
+
+			auto sendRequest=[request,callback]() {
+				QNetworkReply *reply=Manager().get(request);
+				Observe(reply,"GET");
+				Deliver(reply,callback);
+				reply->connect(reply,&QNetworkReply::finished,reply,[]() {
+					queue.pop();
+					if (queue.size() > 0) queue.front().first();
+				},Qt::QueuedConnection);
+			};
+			if (queue.size() == 0) sendRequest();
+			queue.push({sendRequest,callback});
+			break;
+		}
+		case Method::POST:
+		{
+			QNetworkReply *reply=Manager().post(request,payload.isEmpty() ? StringConvert::ByteArray(queryParameters.query()) : payload);
+			Observe(reply,"POST");
+			Deliver(reply,callback);
+			break;
+		}
+		case Method::PATCH:
+		{
+			QNetworkReply *reply=Manager().sendCustomRequest(request,"PATCH"_ba,payload);
+			Observe(reply,"PATCH");
+			Deliver(reply,callback);
+			break;
+		}
+		case Method::DELETE:
+		{
+			QNetworkReply *reply=Manager().sendCustomRequest(request,"DELETE"_ba,payload);
+			Observe(reply,"DELETE");
+			Deliver(reply,callback);
+			break;
+		}
+		}
+	}
+}
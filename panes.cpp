@@ -1,39 +1,97 @@
 #include "panes.h"
+#include "imaging.h"
+#include "typesetting.h"
+#include "trace.h"
 
 #include <QVBoxLayout>
 #include <QStackedLayout>
 #include <QLabel>
 #include <QResizeEvent>
+#include <QPainter>
+#include <QTextDocument>
+#include <QAbstractTextDocumentLayout>
+#include <QElapsedTimer>
 
 const QString StatusPane::SETTINGS_CATEGORY="StatusPane";
 
 StatusPane::StatusPane(QWidget *parent) : PersistentPane(parent),
 	output(this),
+	lines(0,this),
 	settingFont(SETTINGS_CATEGORY,"Font","Droid Sans Mono"),
 	settingFontSize(SETTINGS_CATEGORY,"FontSize",10),
 	settingForegroundColor(SETTINGS_CATEGORY,"ForegroundColor","#ffffffff"),
-	settingBackgroundColor(SETTINGS_CATEGORY,"BackgroundColor","#ff000000")
-{
-	output.setStyleSheet(StyleSheet::Colors<StaticTextEdit>(settingForegroundColor,settingBackgroundColor));
-	output.setFontFamily(settingFont);
-	output.setFontPointSize(settingFontSize);
-	output.document()->setDocumentMargin(16);
+	settingBackgroundColor(SETTINGS_CATEGORY,"BackgroundColor","#ff000000"),
+	settingCapacity(SETTINGS_CATEGORY,"Capacity",5000),
+	settingHiddenSubsystems(SETTINGS_CATEGORY,"HiddenSubsystems",QString())
+{
+	lines.Capacity(static_cast<unsigned int>(settingCapacity));
+	Filter();
+
+	// every row is one line in the same font, so the view can lay out only what's on screen without measuring the rest
+	output.setModel(&lines);
+	output.setUniformItemSizes(true);
+	output.setStyleSheet(StyleSheet::Colors<StaticListView>(settingForegroundColor,settingBackgroundColor));
+	output.setFont(QFont(settingFont,settingFontSize));
+	output.setContentsMargins(16,16,16,16);
+	output.setTextElideMode(Qt::ElideRight);
+	output.setSelectionMode(QAbstractItemView::NoSelection);
+	output.setFocusPolicy(Qt::NoFocus);
 	output.setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 	output.setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 	output.setFrameStyle(QFrame::NoFrame);
 
-	connect(&output,&StaticTextEdit::ContextMenu,this,&StatusPane::ContextMenu);
+	commitClock.setSingleShot(true);
+	commitClock.setTimerType(Qt::PreciseTimer);
+	connect(&commitClock,&QTimer::timeout,this,&StatusPane::Flush);
+	connect(&output,&StaticListView::ContextMenu,this,&StatusPane::ContextMenu);
+	settingCapacity.Watch(this,[this]() {
+		lines.Capacity(static_cast<unsigned int>(settingCapacity));
+	});
+	settingHiddenSubsystems.Watch(this,[this]() {
+		Filter();
+	});
 
 	setLayout(new QVBoxLayout(this));
 	layout()->setContentsMargins(0,0,0,0);
 	layout()->addWidget(&output);
 }
 
+// hidden subsystems are a comma separated list of the names that head log entries (e.g. "channel, eventsub");
+// changing it only affects what's printed from then on
+void StatusPane::Filter()
+{
+	hiddenSubsystems.clear();
+	for (const QString &subsystem : static_cast<QString>(settingHiddenSubsystems).split(',',Qt::SkipEmptyParts))
+	{
+		const QString name=subsystem.trimmed().toUpper();
+		if (!name.isEmpty()) hiddenSubsystems.insert(name);
+	}
+}
+
+// entries are held until the next frame and added together, so a burst of log output costs one model update and one scroll
 void StatusPane::Print(const QString &text)
 {
-	output.insertPlainText(text);
-	output.insertPlainText("\n");
-	output.ensureCursorVisible();
+	if (!hiddenSubsystems.isEmpty() && text.startsWith(u"== "_s))
+	{
+		const QStringView header=QStringView(text).mid(3,text.indexOf('\n')-3); // "== SUBSYSTEM (OPERATION)", with no operation when there wasn't one
+		const qsizetype operation=header.indexOf(u" ("_s);
+		if (hiddenSubsystems.contains(header.left(operation < 0 ? header.size() : operation).toString())) return;
+	}
+
+	QStringList entry=text.split('\n');
+	while (!entry.isEmpty() && entry.back().isEmpty()) entry.removeLast();
+	entry.append(QString()); // a blank line between entries, like there always was
+	pending.append(entry);
+	if (!commitClock.isActive()) commitClock.start(UI::FrameInterval(this));
+}
+
+void StatusPane::Flush()
+{
+	commitClock.stop();
+	if (pending.isEmpty()) return;
+	lines.Append(pending);
+	pending.clear();
+	output.scrollToBottom();
 }
 
 ApplicationSetting& StatusPane::Font()
@@ -56,6 +114,16 @@ ApplicationSetting& StatusPane::BackgroundColor()
 	return settingBackgroundColor;
 }
 
+ApplicationSetting& StatusPane::Capacity()
+{
+	return settingCapacity;
+}
+
+ApplicationSetting& StatusPane::HiddenSubsystems()
+{
+	return settingHiddenSubsystems;
+}
+
 const QString ChatPane::SETTINGS_CATEGORY="ChatPane";
 
 ChatPane::ChatPane(QWidget *parent) : PersistentPane(parent),
@@ -66,7 +134,8 @@ ChatPane::ChatPane(QWidget *parent) : PersistentPane(parent),
 	settingFontSize(SETTINGS_CATEGORY,"FontSize",12),
 	settingForegroundColor(SETTINGS_CATEGORY,"ForegroundColor","#ffffffff"),
 	settingBackgroundColor(SETTINGS_CATEGORY,"BackgroundColor","#ff000000"),
-	settingStatusInterval(SETTINGS_CATEGORY,"StatusInterval",5000)
+	settingStatusInterval(SETTINGS_CATEGORY,"StatusInterval",5000),
+	settingAdaptiveBatching(SETTINGS_CATEGORY,"AdaptiveBatching",true)
 {
 	setLayout(new QVBoxLayout(this));
 	layout()->setContentsMargins(0,0,0,0);
@@ -86,6 +155,7 @@ ChatPane::ChatPane(QWidget *parent) : PersistentPane(parent),
 	chat->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 	chat->setFrameStyle(QFrame::NoFrame);
 	chat->setCursorWidth(0);
+	chat->Adaptive(settingAdaptiveBatching);
 	layout()->addWidget(chat);
 	connect(chat,&PinnedTextEdit::ContextMenu,this,&ChatPane::ContextMenu);
 
@@ -97,8 +167,8 @@ ChatPane::ChatPane(QWidget *parent) : PersistentPane(parent),
 	status->hide();
 	layout()->addWidget(status);
 
-	statusClock.setInterval(TimeConvert::Interval(static_cast<std::chrono::milliseconds>(settingStatusInterval)));
-	connect(&statusClock,&QTimer::timeout,this,&ChatPane::DismissStatus);
+	statusClock.Interval(static_cast<std::chrono::milliseconds>(settingStatusInterval));
+	connect(&statusClock,&Clock::Timer::Timeout,this,&ChatPane::DismissStatus);
 
 	Format();
 }
@@ -113,10 +183,26 @@ void ChatPane::SetAgenda(const QString &text)
 	else
 	{
 		agenda->setText(text);
+		FitAgenda();
 		agenda->show();
 	}
 }
 
+void ChatPane::resizeEvent(QResizeEvent *event)
+{
+	FitAgenda();
+	PersistentPane::resizeEvent(event);
+}
+
+void ChatPane::FitAgenda()
+{
+	// word wrap can't break a single long word, so shrink it to fit instead
+	QFont font(settingFont,static_cast<qreal>(settingFontSize)*1.666,QFont::Bold);
+	const QString text=agenda->text();
+	if (!text.isEmpty() && !text.contains(QChar{32})) font.setPointSize(Typesetting::FitPointSize(font,text,width()-agenda->margin()*2));
+	agenda->setFont(font);
+}
+
 void ChatPane::Format()
 {
 	chat->setStyleSheet(StyleSheet::Colors<PinnedTextEdit>(settingForegroundColor,settingBackgroundColor));
@@ -124,6 +210,14 @@ void ChatPane::Format()
 	chat->setFontPointSize(settingFontSize);
 	chat->document()->setDefaultStyleSheet(QString("div.user { font-family: '%1'; font-size: %2pt; } div.message, span.message { font-family: '%1'; font-size: %3pt; }").arg(static_cast<QString>(settingFont),StringConvert::Integer(static_cast<int>(settingFontSize)*1.333),StringConvert::Integer(static_cast<int>(settingFontSize))));
 	chat->document()->setDocumentMargin(static_cast<qreal>(settingFontSize)*1.333);
+	userFormat=QTextCharFormat();
+	userFormat.setFontFamilies({settingFont});
+	userFormat.setFontPointSize(static_cast<int>(static_cast<int>(settingFontSize)*1.333)); // same sizes the style sheet gives the HTML path
+	messageFormat=QTextCharFormat();
+	messageFormat.setFontFamilies({settingFont});
+	messageFormat.setFontPointSize(static_cast<int>(settingFontSize));
+	imageFormat=QTextImageFormat();
+	imageFormat.setVerticalAlignment(QTextCharFormat::AlignMiddle);
 	status->setStyleSheet(StyleSheet::Colors<QLabel>(settingForegroundColor,settingBackgroundColor));
 	status->setFont(QFont(settingFont,static_cast<qreal>(settingFontSize)*0.833)); // QLabel doesn't have setFontFamily()
 }
@@ -136,6 +230,14 @@ void ChatPane::Refresh()
 
 void ChatPane::Message(const Chat::Message &message) const
 {
+	if (!message.html)
+	{
+		chat->Append([this,message](QTextCursor &cursor) {
+			BuildLine(cursor,message);
+		});
+		return;
+	}
+
 	QString badges;
 	for (const QString &icon : message.badges) badges.append(QString{"<img style='vertical-align: middle;' src='%1' /> "}.arg(icon));
 
@@ -155,12 +257,59 @@ void ChatPane::Message(const Chat::Message &message) const
 		chat->Append(QString("<div>%4</div><div class='user' style='color: %3;'>%1</div><div class='message'>%2<br></div>").arg(message.displayName,emotedMessage,message.color.isValid() ? message.color.name() : settingForegroundColor,badges));
 }
 
+// lays out the same blocks the HTML path produces (badges, then the name, then the message) straight into the document
+void ChatPane::BuildLine(QTextCursor &cursor,const Chat::Message &message) const
+{
+	QTextCharFormat nameFormat=userFormat;
+	nameFormat.setForeground(message.color.isValid() ? message.color : static_cast<QColor>(settingForegroundColor));
+
+	for (const QString &icon : message.badges)
+	{
+		QTextImageFormat badge=imageFormat;
+		badge.setName(icon);
+		cursor.insertImage(badge);
+		cursor.insertText(u" "_s,messageFormat);
+	}
+	cursor.insertBlock();
+
+	cursor.insertText(message.displayName,nameFormat);
+	if (message.action)
+	{
+		QTextCharFormat actionFormat=messageFormat;
+		actionFormat.setForeground(nameFormat.foreground()); // the HTML path's span inherits the name's color
+		cursor.insertText(u" "_s,nameFormat);
+		InsertMessageText(cursor,message,actionFormat);
+	}
+	else
+	{
+		cursor.insertBlock();
+		InsertMessageText(cursor,message,messageFormat);
+	}
+	cursor.insertText(QString(QChar::LineSeparator),messageFormat);
+}
+
+void ChatPane::InsertMessageText(QTextCursor &cursor,const Chat::Message &message,const QTextCharFormat &format) const
+{
+	const QStringView text(message.text);
+	qsizetype position=0;
+	for (const Chat::Emote &emote : message.emotes)
+	{
+		const qsizetype start=emote.start;
+		if (position < start) cursor.insertText(text.mid(position,start-position).toString(),format);
+		QTextImageFormat image=imageFormat;
+		image.setName(emote.path);
+		cursor.insertImage(image);
+		position=static_cast<qsizetype>(emote.end)+1;
+	}
+	if (position < text.size()) cursor.insertText(text.mid(position).toString(),format);
+}
+
 void ChatPane::Print(const QString &text)
 {
 	statuses.push(text);
 	status->setText(statuses.front());
 	status->show();
-	if (!statusClock.isActive()) statusClock.start();
+	if (!statusClock.Active()) statusClock.Start();
 }
 
 void ChatPane::DismissStatus()
@@ -173,7 +322,7 @@ void ChatPane::DismissStatus()
 	}
 	status->clear();
 	status->hide();
-	statusClock.stop();
+	statusClock.Stop();
 }
 
 ApplicationSetting& ChatPane::Font()
@@ -201,10 +350,11 @@ ApplicationSetting& ChatPane::StatusInterval()
 	return settingStatusInterval;
 }
 
-EphemeralPane::EphemeralPane(QWidget *parent,bool highPriority) : QWidget(parent), expired(false), highPriority(highPriority)
+EphemeralPane::EphemeralPane(QWidget *parent,bool highPriority) : QWidget(parent), expired(false), highPriority(highPriority), shown(false), correlation(Trace::Correlation::Current())
 {
 	setVisible(false);
 	connect(this,&EphemeralPane::Finished,this,&EphemeralPane::Expire);
+	if (correlation) installEventFilter(this); // subclasses handle showEvent themselves, so watch for it from the outside
 }
 
 void EphemeralPane::LowerPriority()
@@ -221,10 +371,23 @@ void EphemeralPane::Expire()
 {
 	if (expired) return;
 	expired=true;
+	if (correlation) correlation->Finish("finished");
 	emit Expired();
 	deleteLater();
 }
 
+bool EphemeralPane::eventFilter(QObject *object,QEvent *event)
+{
+	// a pane can be hidden and shown again while a higher priority one plays, but only the first time counts
+	if (object == this && event->type() == QEvent::Show && !shown)
+	{
+		shown=true;
+		correlation->Hop("shown");
+		correlation->Finish("shown");
+	}
+	return QWidget::eventFilter(object,event);
+}
+
 VideoPane::VideoPane(const QString &path,QWidget *parent) noexcept(false) : EphemeralPane(parent), videoPlayer(Multimedia::Player(this,1)), viewport(new QVideoWidget(this))
 {
 	if (!QFile(path).exists()) throw std::runtime_error(QString{"Video doesn't exist ("+path+")"}.toStdString());
@@ -241,6 +404,7 @@ VideoPane::VideoPane(const QString &path,QWidget *parent) noexcept(false) : Ephe
 
 void VideoPane::showEvent(QShowEvent *event)
 {
+	Trace::Instant("pane","shown",Subsystem());
 	videoPlayer->play();
 	QWidget::showEvent(event);
 }
@@ -258,8 +422,10 @@ QString VideoPane::Subsystem()
 
 const QString ScrollingPane::SETTINGS_CATEGORY="ScrollingPane";
 
-ScrollingPane::ScrollingPane(const QString &text,QWidget *parent) : EphemeralPane(parent,false),
+ScrollingPane::ScrollingPane(const CommandDescriptions &descriptions,QWidget *parent) : EphemeralPane(parent,false),
 	commands(new ScrollingTextEdit(this)),
+	descriptions(descriptions),
+	layoutWidth(0),
 	settingFont(SETTINGS_CATEGORY,"Font","Copperplate Gothic Bold"),
 	settingFontSize(SETTINGS_CATEGORY,"FontSize",20),
 	settingForegroundColor(SETTINGS_CATEGORY,"ForegroundColor","#ffffffff"),
@@ -279,22 +445,58 @@ ScrollingPane::ScrollingPane(const QString &text,QWidget *parent) : EphemeralPan
 	commands->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 	commands->setFrameStyle(QFrame::NoFrame);
 	commands->setCursorWidth(0);
-	commands->setText(text);
 	gridLayout->addWidget(commands);
 
 	connect(commands,&ScrollingTextEdit::Finished,this,&ScrollingPane::Finished);
 }
 
+void ScrollingPane::resizeEvent(QResizeEvent *event)
+{
+	if (event->size().width() != layoutWidth)
+	{
+		layoutWidth=event->size().width();
+		commands->setText(BuildList(layoutWidth));
+	}
+	EphemeralPane::resizeEvent(event);
+}
+
+QString ScrollingPane::BuildList(int width)
+{
+	const QFont font(settingFont,settingFontSize);
+	const int availableWidth=width-static_cast<int>(commands->document()->documentMargin()*2);
+	QString text;
+	for (const std::tuple<QString,QStringList,QString> &command : descriptions)
+	{
+		// https://doc.qt.io/qt-6/qstring.html#prepend
+		// This operation is typically very fast (constant time),
+		// because QString preallocates extra space at the beginning
+		// of the string data, so it can grow without reallocating
+		// the entire string each time.
+		const QString name=u"!"_s+std::get<0>(command);
+		if (int pointSize=Typesetting::FitPointSize(font,name,availableWidth); pointSize != font.pointSize())
+			text.append(QString("<div class='name'><span style='font-size: %2pt;'>%1</span><br>").arg(name,StringConvert::Integer(pointSize)));
+		else
+			text.append(QString("<div class='name'>%1<br>").arg(name));
+		if (QStringList aliases=std::get<1>(command); !aliases.empty()) text.append(QString("<span class='aliases'>%1<br></span>").arg("!"+std::get<1>(command).join(", !")));
+		text.append(QString("<span class='description'>%1</span><br></div>").arg(std::get<2>(command)));
+	}
+	return text;
+}
+
 QString ScrollingPane::Subsystem()
 {
 	return u"scrolling pane"_s;
 }
 
 const QString AnnouncePane::SETTINGS_CATEGORY="AnnouncePane";
+const int AnnouncePane::MARGIN=16;
 
 AnnouncePane::AnnouncePane(const Lines &lines,QWidget *parent) : EphemeralPane(parent),
 	lines(lines),
-	output(new QLabel(this)),
+	paintTime(0),
+	composeTime(0),
+	paintCount(0),
+	composeCount(0),
 	settingDuration(SETTINGS_CATEGORY,"Duration",5000),
 	settingFont(SETTINGS_CATEGORY,"Font","Copperplate Gothic Bold"),
 	settingFontSize(SETTINGS_CATEGORY,"FontSize",20),
@@ -307,16 +509,10 @@ AnnouncePane::AnnouncePane(const Lines &lines,QWidget *parent) : EphemeralPane(p
 	verticalLayout->setContentsMargins(0,0,0,0);
 	verticalLayout->setSpacing(0);
 
-	output->setStyleSheet(StyleSheet::Colors<QLabel>(settingForegroundColor,settingBackgroundColor));
-	output->setFont(QFont(settingFont,settingFontSize,QFont::Bold));
-	output->setMargin(16);
-	output->setAlignment(Qt::AlignCenter);
-	output->setWordWrap(true);
-	output->setTextFormat(Qt::RichText);
+	typeface=QFont(settingFont,settingFontSize,QFont::Bold);
 
-	clock.setSingleShot(true);
-	connect(&clock,&QTimer::timeout,this,&AnnouncePane::Finished);
-	connect(this,&AnnouncePane::Resized,this,&AnnouncePane::AdjustText,Qt::QueuedConnection);
+	clock.SingleShot(true);
+	connect(&clock,&Clock::Timer::Timeout,this,&AnnouncePane::Finished);
 }
 
 AnnouncePane::AnnouncePane(const QString &text,QWidget *parent) : AnnouncePane(Lines{},parent)
@@ -337,42 +533,88 @@ bool AnnouncePane::event(QEvent *event)
 
 void AnnouncePane::showEvent(QShowEvent *event)
 {
-	clock.setInterval(TimeConvert::Interval(static_cast<std::chrono::milliseconds>(settingDuration)));
-	clock.start();
+	Trace::Instant("pane","shown",Subsystem());
+	clock.Start(static_cast<std::chrono::milliseconds>(settingDuration));
 	QWidget::showEvent(event);
 }
 
 void AnnouncePane::hideEvent(QHideEvent *event)
 {
-	clock.stop();
+	clock.Stop();
+	if (paintCount > 0) emit Print(QString("Painted %1 frames in %2ms, composited %3 times in %4ms").arg(StringConvert::PositiveInteger(paintCount),QString::number(static_cast<double>(paintTime)/1000000,'f',2),StringConvert::PositiveInteger(composeCount),QString::number(static_cast<double>(composeTime)/1000000,'f',2)),"paint time",Subsystem());
 	QWidget::hideEvent(event);
 }
 
 void AnnouncePane::resizeEvent(QResizeEvent *event)
 {
-	emit Resized(event->size().width());
+	composite=QPixmap();
 	QWidget::resizeEvent(event);
 }
 
-void AnnouncePane::AdjustText(int width)
+void AnnouncePane::paintEvent(QPaintEvent *event)
 {
-	output->setText(BuildParagraph(width));
+	Q_UNUSED(event)
+	Trace::Span span("pane","paint");
+	QElapsedTimer timer;
+	timer.start();
+
+	// static content is baked once per size (and screen) and blitted on every repaint after that
+	const qreal ratio=devicePixelRatioF();
+	if (composite.isNull() || composite.devicePixelRatio() != ratio)
+	{
+		composite=QPixmap(size()*ratio);
+		composite.setDevicePixelRatio(ratio);
+		composite.fill(Qt::transparent);
+		QPainter painter(&composite);
+		Compose(painter);
+		composeTime+=timer.nsecsElapsed();
+		composeCount++;
+	}
+
+	QPainter painter(this);
+	painter.drawPixmap(0,0,composite);
+	paintTime+=timer.nsecsElapsed();
+	paintCount++;
 }
 
 void AnnouncePane::Polish()
 {
-	layout()->addWidget(output);
+}
+
+void AnnouncePane::Compose(QPainter &painter)
+{
+	painter.fillRect(rect(),static_cast<QColor>(settingBackgroundColor));
+	RenderText(painter);
+}
+
+void AnnouncePane::RenderText(QPainter &painter)
+{
+	QTextDocument document;
+	QTextOption option(Qt::AlignHCenter);
+	option.setWrapMode(QTextOption::WordWrap);
+	document.setDefaultTextOption(option);
+	document.setDefaultFont(typeface);
+	document.setDocumentMargin(MARGIN);
+	document.setTextWidth(width());
+	document.setHtml(BuildParagraph(width()));
+
+	QAbstractTextDocumentLayout::PaintContext context;
+	context.palette.setColor(QPalette::Text,settingForegroundColor);
+	painter.save();
+	painter.translate(0,(height()-document.size().height())/2);
+	document.documentLayout()->draw(&painter,context);
+	painter.restore();
 }
 
 QString AnnouncePane::BuildParagraph(int width)
 {
 	QString paragraph;
-	QFont font=output->font();
+	QFont font=typeface;
 	for (const Line &line : lines)
 	{
-		font.setPointSizeF(output->font().pointSizeF()*line.second);
-		int pointSize=line.first.contains(QChar{32}) ? font.pointSize() : StringConvert::RestrictFontWidth(font,line.first,width-output->margin()*2);
-		if (line.second == 1 && font.pointSizeF() == output->font().pointSizeF())
+		font.setPointSizeF(typeface.pointSizeF()*line.second);
+		int pointSize=line.first.contains(QChar{32}) ? font.pointSize() : Typesetting::FitPointSize(font,line.first,width-MARGIN*2);
+		if (line.second == 1 && font.pointSizeF() == typeface.pointSizeF())
 			paragraph.append(QString("%1").arg(line.first));
 		else
 			paragraph.append(QString(R"(<span style="font-size: %2pt;">%1</span>)").arg(line.first,StringConvert::Integer(pointSize)));
@@ -465,22 +707,10 @@ QString AudioAnnouncePane::Subsystem()
 	return u"audible announce pane"_s;
 }
 
-ImageAnnouncePane::ImageAnnouncePane(const Lines &lines,const QImage &image,QWidget *parent) : AnnouncePane(lines,parent), view(nullptr), stack(nullptr), shadow(nullptr), image(image), pixmap(nullptr)
-{
-	stack=new QStackedWidget(this);
-	qobject_cast<QStackedLayout*>(stack->layout())->setStackingMode(QStackedLayout::StackAll);
-
-	scene=new QGraphicsScene(this);
-	view=new QGraphicsView(scene);
-	view->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
-	view->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
-	pixmap=new QGraphicsPixmapItem(); // the scene takes ownership of the pixmap pointer
-	scene->addItem(pixmap);
+const qreal ImageAnnouncePane::SHADOW_BLUR_RADIUS=50; // TODO: abstract this out to a setting
 
-	shadow=new QGraphicsDropShadowEffect();
-	shadow->setBlurRadius(50); // TODO: abstract this out to a setting
-	shadow->setOffset(0,0);
-	output->setGraphicsEffect(shadow);
+ImageAnnouncePane::ImageAnnouncePane(const Lines &lines,const QImage &image,QWidget *parent) : AnnouncePane(lines,parent), image(image)
+{
 }
 
 ImageAnnouncePane::ImageAnnouncePane(const QString &text,const QImage &image,QWidget *parent) : ImageAnnouncePane(Lines{},image,parent)
@@ -488,22 +718,27 @@ ImageAnnouncePane::ImageAnnouncePane(const QString &text,const QImage &image,QWi
 	SingleLine(text);
 }
 
-void ImageAnnouncePane::resizeEvent(QResizeEvent *event)
+void ImageAnnouncePane::Compose(QPainter &painter)
 {
-	if (!expired)
-	{
-		int coverSize=std::max(event->size().width(),event->size().height());
-		if (!image.isNull()) pixmap->setPixmap(QPixmap::fromImage(QImage(image).scaled(QSize(coverSize,coverSize))));
-	}
-	AnnouncePane::resizeEvent(event);
-}
+	const qreal ratio=painter.device()->devicePixelRatioF();
+	const int coverSize=std::max(width(),height());
+	if (!image.isNull()) painter.drawPixmap(QRect((width()-coverSize)/2,(height()-coverSize)/2,coverSize,coverSize),Imaging::Pixmap(image,QSize(coverSize,coverSize)*ratio));
 
-void ImageAnnouncePane::Polish()
-{
+	QPixmap layer(size()*ratio);
+	layer.setDevicePixelRatio(ratio);
+	layer.fill(Qt::transparent);
+	QPainter layerPainter(&layer);
+	AnnouncePane::Compose(layerPainter);
+	layerPainter.end();
+
+	// the blur is the expensive part, so it's rendered through a throwaway scene exactly once per composite
+	QGraphicsScene scene;
+	QGraphicsDropShadowEffect *shadow=new QGraphicsDropShadowEffect();
+	shadow->setBlurRadius(SHADOW_BLUR_RADIUS);
+	shadow->setOffset(0,0);
 	shadow->setColor(settingAccentColor);
-	stack->addWidget(output);
-	stack->addWidget(view);
-	layout()->addWidget(stack);
+	scene.addPixmap(layer)->setGraphicsEffect(shadow); // the item takes ownership of the effect
+	scene.render(&painter,rect(),rect());
 }
 
 QString ImageAnnouncePane::Subsystem()
@@ -534,6 +769,11 @@ void MultimediaAnnouncePane::Polish()
 	layout()->addWidget(imagePane);
 }
 
+void MultimediaAnnouncePane::paintEvent(QPaintEvent *event)
+{
+	QWidget::paintEvent(event); // the audio and image panes paint themselves, there's nothing to composite here
+}
+
 void MultimediaAnnouncePane::showEvent(QShowEvent *event)
 {
 	audioPane->show();
@@ -3,16 +3,17 @@
 #include <QWidget>
 #include <QLabel>
 #include <QTextEdit>
-#include <QStackedWidget>
+#include <QTextCharFormat>
 #include <QGraphicsScene>
-#include <QGraphicsView>
 #include <QGraphicsDropShadowEffect>
 #include <QGraphicsPixmapItem>
 #include <QMediaPlayer>
 #include <QVideoWidget>
 #include <QTimer>
 #include <QEvent>
+#include <QSet>
 #include <queue>
+#include <tuple>
 #include <unordered_map>
 #include "settings.h"
 #include "widgets.h"
@@ -20,6 +21,7 @@
 
 using Line=std::pair<QString,double>;
 using Lines=std::vector<Line>;
+using CommandDescriptions=std::vector<std::tuple<QString,QStringList,QString>>;
 
 class PersistentPane : public QWidget
 {
@@ -39,17 +41,28 @@ public:
 	ApplicationSetting& FontSize();
 	ApplicationSetting& ForegroundColor();
 	ApplicationSetting& BackgroundColor();
+	ApplicationSetting& Capacity();
+	ApplicationSetting& HiddenSubsystems();
 protected:
-	StaticTextEdit output;
+	StaticListView output;
+	RingListModel lines;
+	QStringList pending;
+	QTimer commitClock;
+	QSet<QString> hiddenSubsystems;
 	ApplicationSetting settingFont;
 	ApplicationSetting settingFontSize;
 	ApplicationSetting settingForegroundColor;
 	ApplicationSetting settingBackgroundColor;
+	ApplicationSetting settingCapacity;
+	ApplicationSetting settingHiddenSubsystems;
 	static const QString SETTINGS_CATEGORY;
+	void Filter();
 signals:
 	void ContextMenu(QContextMenuEvent *event);
 public slots:
 	void Print(const QString &text) override;
+protected slots:
+	void Flush();
 };
 
 class ChatPane : public PersistentPane
@@ -67,15 +80,23 @@ protected:
 	QLabel *agenda;
 	PinnedTextEdit *chat;
 	QLabel *status;
-	QTimer statusClock;
+	Clock::Timer statusClock;
 	std::queue<QString> statuses;
+	QTextCharFormat userFormat;
+	QTextCharFormat messageFormat;
+	QTextImageFormat imageFormat;
 	ApplicationSetting settingFont;
 	ApplicationSetting settingFontSize;
 	ApplicationSetting settingForegroundColor;
 	ApplicationSetting settingBackgroundColor;
 	ApplicationSetting settingStatusInterval;
+	ApplicationSetting settingAdaptiveBatching;
 	static const QString SETTINGS_CATEGORY;
 	void Format();
+	void FitAgenda();
+	void BuildLine(QTextCursor &cursor,const Chat::Message &message) const;
+	void InsertMessageText(QTextCursor &cursor,const Chat::Message &message,const QTextCharFormat &format) const;
+	void resizeEvent(QResizeEvent *event) override;
 signals:
 	void ContextMenu(QContextMenuEvent *event);
 public slots:
@@ -96,7 +117,10 @@ public:
 protected:
 	bool expired;
 	bool highPriority;
+	bool shown;
+	std::shared_ptr<Trace::Correlation> correlation; // whatever event raised the pane, so its latency can be measured once it's on screen
 	void Expire();
+	bool eventFilter(QObject *object,QEvent *event) override;
 	virtual QString Subsystem()=0;
 signals:
 	void Finished();
@@ -121,14 +145,18 @@ class ScrollingPane : public EphemeralPane
 {
 	Q_OBJECT
 public:
-	ScrollingPane(const QString &text,QWidget *parent);
+	ScrollingPane(const CommandDescriptions &descriptions,QWidget *parent);
 protected:
 	ScrollingTextEdit *commands;
+	CommandDescriptions descriptions;
+	int layoutWidth;
 	ApplicationSetting settingFont;
 	ApplicationSetting settingFontSize;
 	ApplicationSetting settingForegroundColor;
 	ApplicationSetting settingBackgroundColor;
 	static const QString SETTINGS_CATEGORY;
+	QString BuildList(int width);
+	void resizeEvent(QResizeEvent *event) override;
 	QString Subsystem() override;
 };
 
@@ -138,7 +166,7 @@ class AnnouncePane : public EphemeralPane
 public:
 	AnnouncePane(const Lines &lines,QWidget *parent);
 	AnnouncePane(const QString &text,QWidget *parent);
-	void Duration(const int duration) { clock.setInterval(duration); }
+	void Duration(const int duration) { clock.Interval(std::chrono::milliseconds(duration)); }
 	ApplicationSetting& Font();
 	ApplicationSetting& FontSize();
 	ApplicationSetting& ForegroundColor();
@@ -147,8 +175,13 @@ public:
 	ApplicationSetting& Duration();
 protected:
 	Lines lines;
-	QLabel *output;
-	QTimer clock;
+	QFont typeface;
+	QPixmap composite;
+	Clock::Timer clock;
+	qint64 paintTime;
+	qint64 composeTime;
+	unsigned int paintCount;
+	unsigned int composeCount;
 	ApplicationSetting settingDuration;
 	ApplicationSetting settingFont;
 	ApplicationSetting settingFontSize;
@@ -156,18 +189,18 @@ protected:
 	ApplicationSetting settingBackgroundColor;
 	ApplicationSetting settingAccentColor;
 	static const QString SETTINGS_CATEGORY;
+	static const int MARGIN;
 	virtual void Polish();
+	virtual void Compose(QPainter &painter);
+	void RenderText(QPainter &painter);
 	QString BuildParagraph(int width);
 	void SingleLine(const QString &text);
 	bool event(QEvent *event) override;
 	void showEvent(QShowEvent *event) override;
 	void hideEvent(QHideEvent *event) override;
 	void resizeEvent(QResizeEvent *event) override;
+	void paintEvent(QPaintEvent *event) override;
 	QString Subsystem() override;
-signals:
-	void Resized(int width);
-protected slots:
-	void AdjustText(int width);
 };
 
 class AudioAnnouncePane : public AnnouncePane
@@ -193,14 +226,9 @@ public:
 	ImageAnnouncePane(const Lines &lines,const QImage &image,QWidget *parent);
 	ImageAnnouncePane(const QString &text,const QImage &image,QWidget *parent);
 protected:
-	QGraphicsScene *scene;
-	QGraphicsView *view;
-	QStackedWidget *stack;
-	QGraphicsDropShadowEffect *shadow;
 	QImage image;
-	QGraphicsPixmapItem *pixmap;
-	void Polish() override;
-	void resizeEvent(QResizeEvent *event) override;
+	static const qreal SHADOW_BLUR_RADIUS;
+	void Compose(QPainter &painter) override;
 	QString Subsystem() override;
 };
 
@@ -217,5 +245,6 @@ protected:
 	void Polish() override;
 	void showEvent(QShowEvent *event) override;
 	void hideEvent(QHideEvent *event) override;
+	void paintEvent(QPaintEvent *event) override;
 	QString Subsystem() override;
 };
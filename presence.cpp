@@ -0,0 +1,110 @@
+#include "presence.h"
+#include "metrics.h"
+#include "globals.h"
+
+const QString Presence::SETTINGS_CATEGORY="Presence";
+
+Presence::Presence(QObject *parent) : QObject(parent),
+	settingBatchWindow(SETTINGS_CATEGORY,"BatchWindow",2000) // in milliseconds
+{
+	batchClock.SingleShot(true);
+	connect(&batchClock,&Clock::Timer::Timeout,this,&Presence::Flush);
+}
+
+bool Presence::Present(const QString &login) const
+{
+	return chatters.contains(login);
+}
+
+std::optional<std::chrono::milliseconds> Presence::Duration(const QString &login) const
+{
+	auto chatter=chatters.find(login);
+	if (chatter == chatters.end()) return std::nullopt;
+	return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::Now()-chatter->second.joined);
+}
+
+std::optional<Clock::TimePoint> Presence::LastActive(const QString &login) const
+{
+	auto chatter=chatters.find(login);
+	if (chatter == chatters.end()) return std::nullopt;
+	return chatter->second.active;
+}
+
+size_t Presence::Count() const
+{
+	return chatters.size();
+}
+
+// remembers where the login stood before anything in this window touched it, which is all a flush needs
+// to tell a real arrival from someone who left and came back (or the other way around) in the same batch
+void Presence::Touch(const QString &login)
+{
+	touched.try_emplace(login,chatters.contains(login));
+	if (!batchClock.Active()) batchClock.Start(static_cast<std::chrono::milliseconds>(settingBatchWindow));
+}
+
+void Presence::Join(const QStringList &logins)
+{
+	const Clock::TimePoint now=Clock::Now();
+	for (const QString &login : logins)
+	{
+		if (login.isEmpty()) continue;
+		Touch(login);
+		chatters.try_emplace(login,Chatter{.joined=now,.active=now});
+	}
+}
+
+void Presence::Part(const QStringList &logins)
+{
+	for (const QString &login : logins)
+	{
+		Touch(login);
+		chatters.erase(login);
+	}
+}
+
+// chatting counts as being here, even if Twitch hasn't gotten around to sending the JOIN yet
+void Presence::Active(const QString &login)
+{
+	const Clock::TimePoint now=Clock::Now();
+	if (auto chatter=chatters.find(login); chatter != chatters.end())
+	{
+		chatter->second.active=now;
+		return;
+	}
+	Touch(login);
+	chatters.try_emplace(login,Chatter{.joined=now,.active=now});
+}
+
+// nobody can be known to be here once the connection drops, and the NAMES reply after reconnecting starts over
+void Presence::Clear()
+{
+	for (const std::pair<const QString,Chatter> &chatter : chatters) touched.try_emplace(chatter.first,true);
+	chatters.clear();
+	Flush();
+}
+
+void Presence::Flush()
+{
+	static Metrics::Gauge &present=Metrics::FindGauge(u"celeste_chatters_present"_s,u"Chatters currently in the channel"_s);
+
+	batchClock.Stop();
+	QStringList arrivals;
+	QStringList departures;
+	for (const std::pair<const QString,bool> &login : touched)
+	{
+		const bool here=chatters.contains(login.first);
+		if (here && !login.second) arrivals.append(login.first);
+		if (!here && login.second) departures.append(login.first);
+	}
+	touched.clear();
+	present.Set(static_cast<qint64>(chatters.size()));
+
+	if (!departures.isEmpty()) emit Departed(departures);
+	if (!arrivals.isEmpty()) emit Arrived(arrivals);
+}
+
+ApplicationSetting& Presence::BatchWindow()
+{
+	return settingBatchWindow;
+}
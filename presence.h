@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QObject>
+#include <QStringList>
+#include <unordered_map>
+#include <optional>
+#include "clock.h"
+#include "settings.h"
+
+// the one place that knows who is in the channel; Twitch sends JOIN and PART in delayed batches (and chatting is
+// proof enough of being here), so changes are collected over a window and only what actually changed goes out
+class Presence : public QObject
+{
+	Q_OBJECT
+public:
+	Presence(QObject *parent=nullptr);
+	bool Present(const QString &login) const;
+	std::optional<std::chrono::milliseconds> Duration(const QString &login) const;
+	std::optional<Clock::TimePoint> LastActive(const QString &login) const;
+	size_t Count() const;
+	ApplicationSetting& BatchWindow();
+protected:
+	struct Chatter
+	{
+		Clock::TimePoint joined;
+		Clock::TimePoint active;
+	};
+	std::unordered_map<QString,Chatter> chatters;
+	std::unordered_map<QString,bool> touched; // whether each login changed this window was present when the window opened
+	Clock::Timer batchClock;
+	ApplicationSetting settingBatchWindow;
+	static const QString SETTINGS_CATEGORY;
+	void Touch(const QString &login);
+signals:
+	void Arrived(const QStringList &logins);
+	void Departed(const QStringList &logins);
+public slots:
+	void Join(const QStringList &logins);
+	void Part(const QStringList &logins);
+	void Active(const QString &login);
+	void Clear();
+	void Flush();
+};
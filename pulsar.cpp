@@ -1,15 +1,37 @@
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
-#include <QLocalSocket>
 #include <QFile>
 #include "pulsar.h"
 #include "globals.h"
+#include "trace.h"
 
 const char *TRIGGER_LIST_FILENAME="pulsar.json";
 const char *JSON_KEY_TRIGGER="trigger";
 const char *JSON_KEY_COMMAND="command";
 const char *JSON_KEY_SOURCES="sources";
+const std::chrono::milliseconds PULSAR_RECONNECT_INTERVAL=std::chrono::seconds(2);
+const std::chrono::milliseconds PULSAR_RECONNECT_LIMIT=std::chrono::seconds(60);
+const unsigned int PULSAR_RECONNECT_ATTEMPTS=6; // failed attempts in a row before retrying stops until the next trigger
+const std::chrono::milliseconds PULSAR_PULSE_EXPIRY=std::chrono::seconds(5);
+const std::chrono::milliseconds PULSAR_ACKNOWLEDGE_TIMEOUT=std::chrono::seconds(10);
+
+Pulsar::Pulsar(QObject *parent) : QObject(parent),
+	socket(this),
+	nextID(0),
+	failures(0),
+	reportConnectionFailure(true),
+	synchronized(false)
+{
+	reconnectClock.setSingleShot(true);
+	connect(&reconnectClock,&QTimer::timeout,this,&Pulsar::Connect);
+	acknowledgeClock.setSingleShot(true);
+	connect(&acknowledgeClock,&QTimer::timeout,this,&Pulsar::Expire);
+	connect(&socket,&QLocalSocket::connected,this,&Pulsar::Connected);
+	connect(&socket,&QLocalSocket::disconnected,this,&Pulsar::Disconnected);
+	connect(&socket,&QLocalSocket::errorOccurred,this,&Pulsar::ConnectionError);
+	connect(&socket,&QLocalSocket::readyRead,this,&Pulsar::Read);
+}
 
 bool Pulsar::LoadTriggers()
 {
@@ -56,6 +78,9 @@ bool Pulsar::LoadTriggers()
 		}
 	}
 
+	// connect right away so OBS's state is mirrored before the first trigger fires
+	if (!triggers.empty()) Connect();
+
 	return true;
 }
 
@@ -74,6 +99,7 @@ void Pulsar::Pulse(const QString &trigger,const QString &command)
 void Pulsar::Pulse(const QString &trigger)
 {
 	static const char *OPERATION="dispatch pulse";
+	Trace::Span span("pulsar","pulse",trigger);
 
 	auto payload=triggers.find(trigger);
 	if (payload == triggers.end())
@@ -82,15 +108,272 @@ void Pulsar::Pulse(const QString &trigger)
 		return;
 	}
 
-	QLocalSocket *socket=new QLocalSocket();
-	connect(socket,&QLocalSocket::connected,socket,[socket,trigger,payload]() {
-		socket->write(QJsonDocument(payload->second).toJson(QJsonDocument::Compact)+'\n');
-	});
-	connect(socket,&QLocalSocket::errorOccurred,socket,[this,socket]() {
-		emit Print(QString("Failed to connect to Pulsar: %1").arg(socket->errorString()),OPERATION);
-	});
-	connect(socket,&QLocalSocket::bytesWritten,socket,[socket]() {
-		socket->deleteLater();
+	// the mirror can only be trusted while nothing is in flight, otherwise it lags behind what's already been sent
+	QJsonArray actions=payload->second;
+	if (synchronized && pending.empty())
+	{
+		actions=Prune(actions);
+		if (actions.isEmpty())
+		{
+			emit Report(uR"(Skipped trigger "%1" because OBS is already in that state)"_s.arg(trigger),OPERATION);
+			return;
+		}
+	}
+
+	const quint64 id=nextID++;
+	pending.try_emplace(id,Pending{
+		.trigger=trigger,
+		.frame=PulsarFrame::Encode({
+			{PULSAR_JSON_KEY_TYPE,PULSAR_MESSAGE_TYPE_PULSE},
+			{PULSAR_JSON_KEY_ID,static_cast<qint64>(id)},
+			{PULSAR_JSON_KEY_ACTIONS,actions}
+		}),
+		.queued=std::chrono::steady_clock::now(),
+		.sent={},
+		.written=false
 	});
-	socket->connectToServer(PULSAR_SOCKET_NAME,QIODevice::WriteOnly);
+
+	if (socket.state() == QLocalSocket::ConnectedState)
+		Flush();
+	else if (socket.state() == QLocalSocket::UnconnectedState)
+		Connect(); // a trigger is worth trying for right away, even in the middle of backing off
+}
+
+void Pulsar::Connect()
+{
+	reconnectClock.stop();
+	Expire();
+	if (socket.state() != QLocalSocket::UnconnectedState) return;
+	if (pending.empty() && triggers.empty()) return;
+	socket.connectToServer(PULSAR_SOCKET_NAME,QIODevice::ReadWrite);
+}
+
+// waits twice as long after every failure in a row, and once OBS clearly isn't running, stops retrying on its own
+// and leaves the next trigger to try again
+void Pulsar::Reconnect()
+{
+	if (reconnectClock.isActive() || socket.state() != QLocalSocket::UnconnectedState) return;
+	if (pending.empty() && (triggers.empty() || failures >= PULSAR_RECONNECT_ATTEMPTS))
+	{
+		if (failures == PULSAR_RECONNECT_ATTEMPTS) emit Print(u"Giving up on reaching Pulsar until the next trigger"_s,"connect");
+		return;
+	}
+	reconnectClock.start(std::min(PULSAR_RECONNECT_INTERVAL*(1 << std::min(failures,PULSAR_RECONNECT_ATTEMPTS)),PULSAR_RECONNECT_LIMIT));
+}
+
+void Pulsar::Expire()
+{
+	const std::chrono::steady_clock::time_point now=std::chrono::steady_clock::now();
+	std::optional<std::chrono::steady_clock::time_point> nextDeadline;
+	for (auto candidate=pending.begin(); candidate != pending.end();)
+	{
+		if (!candidate->second.written && now-candidate->second.queued > PULSAR_PULSE_EXPIRY)
+		{
+			emit Print(uR"(Dropped trigger "%1" because Pulsar could not be reached in time)"_s.arg(candidate->second.trigger),"dispatch pulse");
+			candidate=pending.erase(candidate);
+			continue;
+		}
+		if (candidate->second.written)
+		{
+			// the plugin acknowledges every pulse, even failed ones, so one that's gone quiet isn't coming back
+			const std::chrono::steady_clock::time_point deadline=candidate->second.sent+PULSAR_ACKNOWLEDGE_TIMEOUT;
+			if (now >= deadline)
+			{
+				emit Print(uR"(Dropped trigger "%1" because Pulsar never acknowledged it)"_s.arg(candidate->second.trigger),"dispatch pulse");
+				candidate=pending.erase(candidate);
+				continue;
+			}
+			if (!nextDeadline || deadline < *nextDeadline) nextDeadline=deadline;
+		}
+		++candidate;
+	}
+
+	if (nextDeadline)
+		acknowledgeClock.start(std::chrono::ceil<std::chrono::milliseconds>(*nextDeadline-now));
+	else
+		acknowledgeClock.stop();
+}
+
+void Pulsar::Flush()
+{
+	// frames go out in id order without waiting for acknowledgements
+	Expire();
+	const std::chrono::steady_clock::time_point now=std::chrono::steady_clock::now();
+	for (std::pair<const quint64,Pending> &pulse : pending)
+	{
+		if (pulse.second.written) continue;
+		socket.write(pulse.second.frame);
+		pulse.second.sent=now;
+		pulse.second.written=true;
+	}
+	if (!pending.empty() && !acknowledgeClock.isActive()) acknowledgeClock.start(PULSAR_ACKNOWLEDGE_TIMEOUT);
+}
+
+void Pulsar::Connected()
+{
+	emit Print("Connected to Pulsar","connect");
+	reportConnectionFailure=true;
+	failures=0;
+	buffer.clear();
+	Flush();
+}
+
+void Pulsar::Disconnected()
+{
+	// anything that was in flight gets resent after reconnecting, which is harmless because every action is idempotent
+	for (std::pair<const quint64,Pending> &pulse : pending) pulse.second.written=false;
+	acknowledgeClock.stop();
+	synchronized=false;
+	scene.clear();
+	scenes.clear();
+	Reconnect();
+}
+
+void Pulsar::ConnectionError(QLocalSocket::LocalSocketError error)
+{
+	if (error == QLocalSocket::PeerClosedError) return;
+	if (reportConnectionFailure)
+	{
+		emit Print(QString("Failed to connect to Pulsar: %1").arg(socket.errorString()),"connect");
+		reportConnectionFailure=false;
+	}
+	failures++;
+	Reconnect();
+}
+
+void Pulsar::Read()
+{
+	Trace::Span span("pulsar","read");
+	buffer.append(socket.readAll());
+	try
+	{
+		while (std::optional<QJsonObject> message=PulsarFrame::Decode(buffer))
+		{
+			const QString type=message->value(PULSAR_JSON_KEY_TYPE).toString();
+			if (type == PULSAR_MESSAGE_TYPE_ACKNOWLEDGE)
+				Acknowledged(*message);
+			else if (type == PULSAR_MESSAGE_TYPE_SNAPSHOT)
+				Synchronize(*message);
+			else if (type == PULSAR_MESSAGE_TYPE_SCENE)
+				SceneChanged(*message);
+			else if (type == PULSAR_MESSAGE_TYPE_ITEM)
+				ItemChanged(*message);
+		}
+	}
+
+	catch (const std::exception &exception)
+	{
+		emit Print(QString("Invalid data received from Pulsar: %1").arg(exception.what()),"receive");
+		buffer.clear();
+		socket.abort();
+	}
+}
+
+void Pulsar::Acknowledged(const QJsonObject &message)
+{
+	static const char *OPERATION="acknowledge pulse";
+
+	auto candidate=pending.find(static_cast<quint64>(message.value(PULSAR_JSON_KEY_ID).toInteger()));
+	if (candidate == pending.end()) return;
+	const Pending &pulse=candidate->second;
+
+	if (const QString error=message.value(PULSAR_JSON_KEY_ERROR).toString(); !error.isEmpty()) emit Print(uR"(Pulsar failed to apply trigger "%1": %2)"_s.arg(pulse.trigger,error),OPERATION);
+	Trace::Complete("pulsar","pulse applied",pulse.queued,pulse.trigger);
+	const std::chrono::steady_clock::time_point now=std::chrono::steady_clock::now();
+	const double latency=std::chrono::duration<double,std::milli>(now-pulse.queued).count();
+	const double roundTrip=std::chrono::duration<double,std::milli>(now-pulse.sent).count();
+	const double applied=message.value(PULSAR_JSON_KEY_APPLY_TIME).toDouble()/1000;
+	emit Report(uR"(Trigger "%1" applied %2ms after dispatch (%3ms round trip, %4ms inside OBS))"_s.arg(pulse.trigger,QString::number(latency,'f',2),QString::number(roundTrip,'f',2),QString::number(applied,'f',2)),OPERATION);
+
+	pending.erase(candidate);
+}
+
+void Pulsar::Synchronize(const QJsonObject &message)
+{
+	scenes.clear();
+	const QJsonObject jsonObjectScenes=message.value(PULSAR_JSON_KEY_SCENES).toObject();
+	for (auto jsonScene=jsonObjectScenes.begin(); jsonScene != jsonObjectScenes.end(); ++jsonScene)
+	{
+		SceneState &sources=scenes[jsonScene.key()];
+		const QJsonObject jsonObjectSources=jsonScene->toObject();
+		for (auto jsonSource=jsonObjectSources.begin(); jsonSource != jsonObjectSources.end(); ++jsonSource) sources.insert_or_assign(jsonSource.key(),State(jsonSource->toObject()));
+	}
+	scene=message.value(PULSAR_JSON_KEY_SCENE).toString();
+	synchronized=true;
+}
+
+void Pulsar::SceneChanged(const QJsonObject &message)
+{
+	scene=message.value(PULSAR_JSON_KEY_SCENE).toString();
+}
+
+void Pulsar::ItemChanged(const QJsonObject &message)
+{
+	scenes[message.value(PULSAR_JSON_KEY_SCENE).toString()].insert_or_assign(message.value(PULSAR_JSON_KEY_SOURCE).toString(),State(message));
+}
+
+Pulsar::SourceState Pulsar::State(const QJsonObject &jsonObject)
+{
+	return {
+		.visible=jsonObject.value(PULSAR_JSON_KEY_VISIBLE).toBool(),
+		.x=static_cast<float>(jsonObject.value(PULSAR_JSON_KEY_X).toDouble()),
+		.y=static_cast<float>(jsonObject.value(PULSAR_JSON_KEY_Y).toDouble())
+	};
+}
+
+QJsonArray Pulsar::Prune(const QJsonArray &actions) const
+{
+	// replays the actions against a scratch copy of the affected sources, following the same scene targeting rules as the plugin
+	// anything the mirror doesn't know about is left for the plugin to accept or reject
+	QJsonArray result;
+	QString target=scene;
+	std::unordered_map<QString,SceneState> projected;
+	auto lookup=[this,&projected](const QString &sceneName,const QString &sourceName) -> SourceState* {
+		if (auto candidate=projected[sceneName].find(sourceName); candidate != projected[sceneName].end()) return &candidate->second;
+		auto mirroredScene=scenes.find(sceneName);
+		if (mirroredScene == scenes.end()) return nullptr;
+		auto mirroredSource=mirroredScene->second.find(sourceName);
+		if (mirroredSource == mirroredScene->second.end()) return nullptr;
+		return &projected[sceneName].insert_or_assign(sourceName,mirroredSource->second).first->second;
+	};
+
+	for (const QJsonValue &jsonValue : actions)
+	{
+		const QJsonObject jsonObject=jsonValue.toObject();
+		const QString type=jsonObject.value(PULSAR_ACTION_KEY_TRIGGER).toString();
+		const QString name=jsonObject.value(PULSAR_ACTION_KEY_NAME).toString();
+
+		if (type == PULSAR_ACTION_SWITCH_SCENE)
+		{
+			if (name != target) result.append(jsonObject);
+			target=name;
+			continue;
+		}
+
+		SourceState *state=lookup(target,name);
+		if (!state)
+		{
+			result.append(jsonObject);
+			continue;
+		}
+
+		if (type == PULSAR_ACTION_ENABLE_SOURCE || type == PULSAR_ACTION_DISABLE_SOURCE)
+		{
+			const bool visible=type == PULSAR_ACTION_ENABLE_SOURCE;
+			if (state->visible == visible) continue;
+			state->visible=visible;
+		}
+		else if (type == PULSAR_ACTION_MOVE_SOURCE)
+		{
+			const QJsonObject position=jsonObject.value(PULSAR_ACTION_KEY_POSITION).toObject();
+			const float x=position.value(PULSAR_JSON_KEY_X).toVariant().toFloat();
+			const float y=position.value(PULSAR_JSON_KEY_Y).toVariant().toFloat();
+			if (state->x == x && state->y == y) continue;
+			state->x=x;
+			state->y=y;
+		}
+		result.append(jsonObject);
+	}
+
+	return result;
 }
@@ -1,19 +1,125 @@
+#pragma once
+
 #include <QObject>
 #include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QTimer>
+#include <QtEndian>
+#include <unordered_map>
+#include <map>
+#include <optional>
+#include <chrono>
+#include <stdexcept>
 
 inline const char *PULSAR_SOCKET_NAME="pulsar-obs";
+inline const char *PULSAR_JSON_KEY_TYPE="type";
+inline const char *PULSAR_JSON_KEY_ID="id";
+inline const char *PULSAR_JSON_KEY_ACTIONS="actions";
+inline const char *PULSAR_JSON_KEY_APPLY_TIME="applied";
+inline const char *PULSAR_JSON_KEY_ERROR="error";
+inline const char *PULSAR_JSON_KEY_SCENE="scene";
+inline const char *PULSAR_JSON_KEY_SCENES="scenes";
+inline const char *PULSAR_JSON_KEY_SOURCE="source";
+inline const char *PULSAR_JSON_KEY_VISIBLE="visible";
+inline const char *PULSAR_JSON_KEY_X="x";
+inline const char *PULSAR_JSON_KEY_Y="y";
+inline const char *PULSAR_MESSAGE_TYPE_PULSE="pulse";
+inline const char *PULSAR_MESSAGE_TYPE_ACKNOWLEDGE="ack";
+inline const char *PULSAR_MESSAGE_TYPE_SNAPSHOT="snapshot";
+inline const char *PULSAR_MESSAGE_TYPE_SCENE="scene";
+inline const char *PULSAR_MESSAGE_TYPE_ITEM="item";
+inline const char *PULSAR_ACTION_KEY_TRIGGER="trigger";
+inline const char *PULSAR_ACTION_KEY_NAME="name";
+inline const char *PULSAR_ACTION_KEY_POSITION="position";
+inline const char *PULSAR_ACTION_SWITCH_SCENE="switch_scene";
+inline const char *PULSAR_ACTION_ENABLE_SOURCE="enable_source";
+inline const char *PULSAR_ACTION_DISABLE_SOURCE="disable_source";
+inline const char *PULSAR_ACTION_MOVE_SOURCE="move_source";
+
+// shared by Celeste and the OBS plugin, so everything here has to stay header-only
+namespace PulsarFrame
+{
+	inline const quint32 MAX_LENGTH=16*1024*1024;
+
+	inline QByteArray Encode(const QJsonObject &message)
+	{
+		const QByteArray payload=QJsonDocument(message).toJson(QJsonDocument::Compact);
+		QByteArray frame(sizeof(quint32),Qt::Uninitialized);
+		qToBigEndian<quint32>(static_cast<quint32>(payload.size()),frame.data());
+		return frame+payload;
+	}
+
+	// removes one complete frame from the front of the buffer, leaving a partial frame for the next read
+	inline std::optional<QJsonObject> Decode(QByteArray &buffer)
+	{
+		if (buffer.size() < static_cast<qsizetype>(sizeof(quint32))) return std::nullopt;
+		const quint32 length=qFromBigEndian<quint32>(buffer.constData());
+		if (length > MAX_LENGTH) throw std::length_error("Pulsar frame exceeds maximum length");
+		if (buffer.size()-static_cast<qsizetype>(sizeof(quint32)) < static_cast<qsizetype>(length)) return std::nullopt;
+		QJsonParseError jsonError;
+		const QJsonDocument document=QJsonDocument::fromJson(buffer.mid(sizeof(quint32),length),&jsonError);
+		buffer.remove(0,sizeof(quint32)+length);
+		if (document.isNull()) throw std::runtime_error("Failed to parse JSON in Pulsar frame: "+jsonError.errorString().toStdString());
+		return document.object();
+	}
+}
 
 class Pulsar : public QObject
 {
 	Q_OBJECT
 public:
+	Pulsar(QObject *parent=nullptr);
 	bool LoadTriggers();
 protected:
+	struct Pending
+	{
+		QString trigger;
+		QByteArray frame;
+		std::chrono::steady_clock::time_point queued;
+		std::chrono::steady_clock::time_point sent;
+		bool written;
+	};
+	struct SourceState
+	{
+		bool visible;
+		float x;
+		float y;
+	};
+	using SceneState=std::unordered_map<QString,SourceState>;
 	std::unordered_map<QString,QJsonArray> triggers;
 	std::unordered_map<QString,QString> commandCrossReference;
+	QLocalSocket socket;
+	QTimer reconnectClock;
+	QTimer acknowledgeClock;
+	QByteArray buffer;
+	std::map<quint64,Pending> pending;
+	quint64 nextID;
+	unsigned int failures;
+	bool reportConnectionFailure;
+	bool synchronized;
+	QString scene;
+	std::unordered_map<QString,SceneState> scenes;
+	void Connect();
+	void Reconnect();
+	void Expire();
+	void Flush();
+	void Acknowledged(const QJsonObject &message);
+	void Synchronize(const QJsonObject &message);
+	void SceneChanged(const QJsonObject &message);
+	void ItemChanged(const QJsonObject &message);
+	QJsonArray Prune(const QJsonArray &actions) const;
+	static SourceState State(const QJsonObject &jsonObject);
 signals:
 	void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("Pulsar"));
+	void Report(const QString &message,const QString operation=QString(),const QString subsystem=QString("Pulsar"));
 public slots:
 	void Pulse(const QString &trigger,const QString &command);
 	void Pulse(const QString &trigger);
+protected slots:
+	void Connected();
+	void Disconnected();
+	void ConnectionError(QLocalSocket::LocalSocketError error);
+	void Read();
 };
@@ -2,8 +2,10 @@
 #include <obs-source.h>
 #include <obs-frontend-api.h>
 #include <util/base.h>
+#include <util/platform.h>
 #include <QLocalServer>
 #include <QLocalSocket>
+#include <QPointer>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
@@ -12,18 +14,23 @@
 #include <QVBoxLayout>
 #include <QCheckBox>
 #include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <optional>
 #include <iostream>
 #include "pulsar.h"
 
 OBS_DECLARE_MODULE()
 
 const char *SUBSYSTEM_NAME="[Pulsar]";
-const char *JSON_KEY_SOURCE_NAME="name";
-const char *JSON_KEY_SCENE_NAME="name";
-const char *JSON_KEY_SOURCE_TRIGGER="trigger";
-const char *JSON_KEY_SOURCE_POSITION="position";
-const char *JSON_KEY_SOURCE_POSITION_X="x";
-const char *JSON_KEY_SOURCE_POSITION_Y="y";
+const char *JSON_KEY_SOURCE_NAME=PULSAR_ACTION_KEY_NAME;
+const char *JSON_KEY_SCENE_NAME=PULSAR_ACTION_KEY_NAME;
+const char *JSON_KEY_SOURCE_TRIGGER=PULSAR_ACTION_KEY_TRIGGER;
+const char *JSON_KEY_SOURCE_POSITION=PULSAR_ACTION_KEY_POSITION;
+const char *JSON_KEY_SOURCE_POSITION_X=PULSAR_JSON_KEY_X;
+const char *JSON_KEY_SOURCE_POSITION_Y=PULSAR_JSON_KEY_Y;
 
 void Log(const std::string &message)
 {
@@ -41,13 +48,222 @@ using ScenePtr=std::unique_ptr<obs_scene_t,decltype(&obs_scene_release)>;
 using SceneItemPtr=std::unique_ptr<obs_sceneitem_t,decltype(&obs_sceneitem_release)>;
 using SourcePtr=std::unique_ptr<obs_source_t,decltype(&obs_source_release)>;
 using SourceListPtr=std::unique_ptr<obs_frontend_source_list,decltype(&obs_frontend_source_list_free)>;
+using WeakSourcePtr=std::unique_ptr<obs_weak_source_t,decltype(&obs_weak_source_release)>;
+
+QLocalServer *server=nullptr;
+QCheckBox *enabled;
+std::vector<QPointer<QLocalSocket>> clients;
+
+// pushes scene and item state to every connected client so Celeste can mirror what OBS is showing
+// everything is written from the UI thread in the order it was queued, which keeps state changes caused by a batch ahead of its acknowledgements
+namespace Feedback
+{
+	std::atomic<bool> resynchronizing=false;
+
+	void Send(QLocalSocket *socket,const QByteArray &frame)
+	{
+		if (!server) return;
+		QMetaObject::invokeMethod(server,[socket=QPointer<QLocalSocket>(socket),frame]() {
+			if (socket) socket->write(frame);
+		},Qt::QueuedConnection);
+	}
+
+	void Broadcast(const QJsonObject &message)
+	{
+		if (!server) return;
+		QMetaObject::invokeMethod(server,[frame=PulsarFrame::Encode(message)]() {
+			for (QPointer<QLocalSocket> &client : clients)
+			{
+				if (client) client->write(frame);
+			}
+		},Qt::QueuedConnection);
+	}
+
+	QJsonObject ItemState(obs_sceneitem_t *item)
+	{
+		vec2 position;
+		obs_sceneitem_get_pos(item,&position);
+		return {
+			{PULSAR_JSON_KEY_VISIBLE,obs_sceneitem_visible(item)},
+			{PULSAR_JSON_KEY_X,position.x},
+			{PULSAR_JSON_KEY_Y,position.y}
+		};
+	}
+
+	void ItemChanged(void *data,calldata_t *arguments)
+	{
+		Q_UNUSED(data)
+		obs_scene_t *scene=static_cast<obs_scene_t*>(calldata_ptr(arguments,"scene"));
+		obs_sceneitem_t *item=static_cast<obs_sceneitem_t*>(calldata_ptr(arguments,"item"));
+		if (!scene || !item) return;
+		QJsonObject message=ItemState(item);
+		message.insert(PULSAR_JSON_KEY_TYPE,PULSAR_MESSAGE_TYPE_ITEM);
+		message.insert(PULSAR_JSON_KEY_SCENE,obs_source_get_name(obs_scene_get_source(scene)));
+		message.insert(PULSAR_JSON_KEY_SOURCE,obs_source_get_name(obs_sceneitem_get_source(item)));
+		Broadcast(message);
+	}
+
+	void SceneChanged(const std::string &name)
+	{
+		Broadcast({
+			{PULSAR_JSON_KEY_TYPE,PULSAR_MESSAGE_TYPE_SCENE},
+			{PULSAR_JSON_KEY_SCENE,QString::fromStdString(name)}
+		});
+	}
+
+	void Resynchronize();
+}
+
+// name -> handle lookups for every scene and the top-level items in it
+// scenes are held weakly, items are held strongly but only until the next rebuild, which any item add/remove or rename forces
+namespace Index
+{
+	struct Scene
+	{
+		WeakSourcePtr source;
+		std::unordered_map<std::string,SceneItemPtr> items;
+	};
+
+	std::mutex lock;
+	std::unordered_map<std::string,Scene> scenes;
+	std::vector<WeakSourcePtr> watched;
+	std::atomic<uint64_t> generation=1;
+	uint64_t builtGeneration=0;
+
+	// signals can arrive on any thread, so invalidating only bumps a counter and the next lookup rebuilds
+	void Invalidate()
+	{
+		generation++;
+		Feedback::Resynchronize();
+	}
+
+	void Invalidated(void *data,calldata_t *arguments)
+	{
+		Q_UNUSED(data)
+		Q_UNUSED(arguments)
+		Invalidate();
+	}
+
+	void Unwatch()
+	{
+		for (const WeakSourcePtr &weakSource : watched)
+		{
+			SourcePtr source(obs_weak_source_get_source(weakSource.get()),&obs_source_release);
+			if (!source) continue;
+			signal_handler_t *signals=obs_source_get_signal_handler(source.get());
+			signal_handler_disconnect(signals,"item_add",Invalidated,nullptr);
+			signal_handler_disconnect(signals,"item_remove",Invalidated,nullptr);
+			signal_handler_disconnect(signals,"item_visible",Feedback::ItemChanged,nullptr);
+			signal_handler_disconnect(signals,"item_transform",Feedback::ItemChanged,nullptr);
+		}
+		watched.clear();
+	}
+
+	void Clear()
+	{
+		Unwatch();
+		scenes.clear();
+		builtGeneration=0;
+	}
+
+	bool IndexItem(obs_scene_t *scene,obs_sceneitem_t *item,void *data)
+	{
+		Q_UNUSED(scene)
+		obs_sceneitem_addref(item);
+		static_cast<std::unordered_map<std::string,SceneItemPtr>*>(data)->try_emplace(obs_source_get_name(obs_sceneitem_get_source(item)),SceneItemPtr(item,&obs_sceneitem_release)); // first match wins, same as obs_scene_find_source()
+		return true;
+	}
+
+	// caller must hold the lock
+	void Refresh()
+	{
+		const uint64_t currentGeneration=generation;
+		if (builtGeneration == currentGeneration) return;
+
+		Clear();
+		SourceListPtr sceneList(new obs_frontend_source_list({0}),&obs_frontend_source_list_free);
+		obs_frontend_get_scenes(sceneList.get());
+		for (size_t sceneIndex=0; sceneIndex < sceneList->sources.num; sceneIndex++)
+		{
+			obs_source_t *source=sceneList->sources.array[sceneIndex];
+			Scene entry{WeakSourcePtr(obs_source_get_weak_source(source),&obs_weak_source_release),{}};
+			obs_scene_enum_items(obs_scene_from_source(source),IndexItem,&entry.items);
+			scenes.try_emplace(obs_source_get_name(source),std::move(entry));
+
+			signal_handler_t *signals=obs_source_get_signal_handler(source);
+			signal_handler_connect(signals,"item_add",Invalidated,nullptr);
+			signal_handler_connect(signals,"item_remove",Invalidated,nullptr);
+			signal_handler_connect(signals,"item_visible",Feedback::ItemChanged,nullptr);
+			signal_handler_connect(signals,"item_transform",Feedback::ItemChanged,nullptr);
+			watched.emplace_back(obs_source_get_weak_source(source),&obs_weak_source_release);
+		}
+		builtGeneration=currentGeneration;
+	}
+}
+
+namespace Feedback
+{
+	QJsonObject Snapshot()
+	{
+		QJsonObject scenes;
+		{
+			std::lock_guard<std::mutex> guard(Index::lock);
+			Index::Refresh();
+			for (const std::pair<const std::string,Index::Scene> &scene : Index::scenes)
+			{
+				QJsonObject sources;
+				for (const std::pair<const std::string,SceneItemPtr> &source : scene.second.items) sources.insert(QString::fromStdString(source.first),ItemState(source.second.get()));
+				scenes.insert(QString::fromStdString(scene.first),sources);
+			}
+		}
+		SourcePtr currentScene(obs_frontend_get_current_scene(),&obs_source_release);
+		return {
+			{PULSAR_JSON_KEY_TYPE,PULSAR_MESSAGE_TYPE_SNAPSHOT},
+			{PULSAR_JSON_KEY_SCENE,currentScene ? obs_source_get_name(currentScene.get()) : ""},
+			{PULSAR_JSON_KEY_SCENES,scenes}
+		};
+	}
+
+	// any structural change (items added or removed, renames, a new scene list) is answered with a full snapshot
+	// repeated requests before the snapshot goes out collapse into one
+	void Resynchronize()
+	{
+		if (!server || resynchronizing.exchange(true)) return;
+		QMetaObject::invokeMethod(server,[]() {
+			resynchronizing=false;
+			if (clients.empty()) return;
+			const QByteArray frame=PulsarFrame::Encode(Snapshot());
+			for (QPointer<QLocalSocket> &client : clients)
+			{
+				if (client) client->write(frame);
+			}
+		},Qt::QueuedConnection);
+	}
+}
 
 void HandleEvent(obs_frontend_event event,void *data)
 {
 	switch (event)
 	{
 		case OBS_FRONTEND_EVENT_SCENE_CHANGED:
-			Log("Scene Changed: "+std::string(obs_source_get_name(SourcePtr(obs_frontend_get_current_scene(),&obs_source_release).get())));
+		{
+			const std::string name=obs_source_get_name(SourcePtr(obs_frontend_get_current_scene(),&obs_source_release).get());
+			Log("Scene Changed: "+name);
+			Feedback::SceneChanged(name);
+			break;
+		}
+		case OBS_FRONTEND_EVENT_SCENE_LIST_CHANGED:
+		case OBS_FRONTEND_EVENT_SCENE_COLLECTION_CHANGED:
+			Index::Invalidate();
+			break;
+		case OBS_FRONTEND_EVENT_SCENE_COLLECTION_CLEANUP:
+		case OBS_FRONTEND_EVENT_EXIT:
+		{
+			std::lock_guard<std::mutex> guard(Index::lock);
+			Index::Clear();
+			break;
+		}
+		default:
 			break;
 	}
 }
@@ -60,123 +276,282 @@ enum Triggers
 	MOVE_SOURCE
 };
 std::unordered_map<std::string,int> triggers={
-	{"switch_scene",SWITCH_SCENE},
-	{"enable_source",ENABLE_SOURCE},
-	{"disable_source",DISABLE_SOURCE},
-	{"move_source",MOVE_SOURCE}
+	{PULSAR_ACTION_SWITCH_SCENE,SWITCH_SCENE},
+	{PULSAR_ACTION_ENABLE_SOURCE,ENABLE_SOURCE},
+	{PULSAR_ACTION_DISABLE_SOURCE,DISABLE_SOURCE},
+	{PULSAR_ACTION_MOVE_SOURCE,MOVE_SOURCE}
 };
 
-QLocalServer *server;
-QCheckBox *enabled;
-
-obs_sceneitem_t* FindSource(const std::string &name)
+obs_source_t* FindScene(const std::string &name)
 {
-	obs_scene_t *scene=obs_scene_from_source(SourcePtr(obs_frontend_get_current_scene(),&obs_source_release).get()); // passing NULL into obs_scene_from_source() does not crash
-	if (!scene) throw std::runtime_error("Could not determine current scene");
-	obs_sceneitem_t *source=obs_scene_find_source(scene,name.data()); // does not increment reference! (https://obsproject.com/forum/threads/quesiton-of-obs_scene_find_source.106113/)
-	if (!source)
+	std::lock_guard<std::mutex> guard(Index::lock);
+	Index::Refresh();
+	auto candidate=Index::scenes.find(name);
+	if (candidate != Index::scenes.end())
 	{
-		source=obs_scene_get_group(scene,name.data()); // might be a group of sources instead of a single source
-		if (!source) throw std::runtime_error("Could not find source ("+name+") in scene.");
+		if (obs_source_t *scene=obs_weak_source_get_source(candidate->second.source.get()); scene) return scene;
 	}
-	return source;
+	throw std::runtime_error("Scene ("+name+") could not be found");
+}
+
+SceneItemPtr FindSource(const std::string &sceneName,const std::string &name)
+{
+	std::lock_guard<std::mutex> guard(Index::lock);
+	Index::Refresh();
+	auto scene=Index::scenes.find(sceneName);
+	if (scene == Index::scenes.end()) throw std::runtime_error("Scene ("+sceneName+") could not be found");
+	auto source=scene->second.items.find(name); // groups are top-level items too, so they're in here as well
+	if (source == scene->second.items.end()) throw std::runtime_error("Could not find source ("+name+") in scene.");
+	obs_sceneitem_addref(source->second.get());
+	return SceneItemPtr(source->second.get(),&obs_sceneitem_release);
 }
 
-void MoveSource(const std::string &name,const QJsonObject &jsonObject)
+std::string CurrentScene()
 {
-	Log("Move Source: "+name);
+	SourcePtr currentScene(obs_frontend_get_current_scene(),&obs_source_release);
+	if (!currentScene) throw std::runtime_error("Could not determine current scene");
+	return obs_source_get_name(currentScene.get());
+}
 
+vec2 Position(const QJsonObject &jsonObject)
+{
 	if (jsonObject.isEmpty()) throw std::runtime_error("Invalid tranformation information");
-	vec2 pos {
+	return {
 		jsonObject.value(JSON_KEY_SOURCE_POSITION_X).toVariant().toFloat(),
 		jsonObject.value(JSON_KEY_SOURCE_POSITION_Y).toVariant().toFloat()
 	};
-
-	obs_sceneitem_set_pos(FindSource(name),&pos);
 }
 
-void ShowSource(const std::string &name)
+void Acknowledge(QLocalSocket *socket,qint64 id,uint64_t applyTime,const std::string &error)
 {
-	Log("Show Source: "+name);
-	obs_sceneitem_set_visible(FindSource(name),true);
+	QJsonObject acknowledgement{
+		{PULSAR_JSON_KEY_TYPE,PULSAR_MESSAGE_TYPE_ACKNOWLEDGE},
+		{PULSAR_JSON_KEY_ID,id},
+		{PULSAR_JSON_KEY_APPLY_TIME,static_cast<qint64>(applyTime/1000)} // microseconds
+	};
+	if (!error.empty()) acknowledgement.insert(PULSAR_JSON_KEY_ERROR,QString::fromStdString(error));
+	Feedback::Send(socket,PulsarFrame::Encode(acknowledgement));
 }
 
-void HideSource(const std::string &name)
+// everything that arrives between two video ticks is applied together on the UI thread,
+// with all item changes for a scene made inside one atomic scene update
+namespace Batch
 {
-	Log("Hide Source: "+name);
-	obs_sceneitem_set_visible(FindSource(name),false);
-}
+	struct Pulse
+	{
+		QPointer<QLocalSocket> socket;
+		qint64 id;
+		QJsonArray actions;
+		uint64_t received;
+	};
 
-obs_source_t* FindScene(const std::string &name)
-{
-	SourceListPtr scenes(new obs_frontend_source_list({0}),&obs_frontend_source_list_free);
-	obs_frontend_get_scenes(scenes.get());
-	for (size_t sceneIndex=0; sceneIndex < scenes->sources.num; sceneIndex++)
+	struct Change
+	{
+		std::optional<bool> visible;
+		std::optional<vec2> position;
+	};
+
+	using Changes=std::vector<std::pair<SceneItemPtr,Change>>;
+
+	std::mutex lock;
+	std::vector<Pulse> queued;
+
+	void Queue(Pulse &&pulse)
 	{
-		obs_source_t *candidate=scenes->sources.array[sceneIndex];
-		if (std::string(obs_source_get_name(candidate)) == name) return obs_source_get_ref(candidate);
+		std::lock_guard<std::mutex> guard(lock);
+		queued.push_back(std::move(pulse));
 	}
-	throw std::runtime_error("Scene ("+name+") could not be found");
-}
 
-void SwitchScene(const std::string &name)
-{
-	obs_frontend_set_current_scene(SourcePtr(FindScene(name),&obs_source_release).get());
-}
+	void Update(void *data,obs_scene_t *scene)
+	{
+		Q_UNUSED(scene)
+		for (std::pair<SceneItemPtr,Change> &item : *static_cast<Changes*>(data))
+		{
+			if (item.second.position) obs_sceneitem_set_pos(item.first.get(),&*item.second.position);
+			if (item.second.visible) obs_sceneitem_set_visible(item.first.get(),*item.second.visible);
+		}
+	}
 
-void Connection()
-{
-	Log("Incoming connection established");
+	using Staged=std::unordered_map<std::string,std::unordered_map<std::string,Change>>;
 
-	QLocalSocket *socket=server->nextPendingConnection();
-	socket->connect(socket,&QLocalSocket::readyRead,socket,[socket]() {
-		try
+	// checks one pulse's actions against the current scenes without touching anything, so a pulse either goes in whole or not at all
+	void Stage(const Pulse &pulse,std::string &target,std::optional<std::string> &switchTo,Staged &changes)
+	{
+		for (const QJsonValue &jsonValue : pulse.actions)
 		{
-			// read json from socket
-			QByteArray data=socket->readAll().trimmed();
+			QJsonObject jsonObject=jsonValue.toObject();
 
-			if (!enabled->isChecked()) return;
+			// look for trigger name and bail if we don't recognize it
+			std::string name=jsonObject.value(JSON_KEY_SOURCE_TRIGGER).toString().toStdString();
+			Log("Trigger: "+name);
+			if (triggers.find(name) == triggers.end()) throw std::runtime_error("Unrecognized trigger received: "+name);
 
-			// parse triggers out of json
-			QJsonParseError jsonError;
-			QJsonDocument jsonDocument=QJsonDocument::fromJson(data,&jsonError);
-			if (jsonDocument.isNull()) throw std::runtime_error("Failed to parse JSON: "+jsonError.errorString().toStdString());
-			const QJsonArray jsonArray=jsonDocument.array();
-			for (const QJsonValue &jsonValue : jsonArray)
+			switch (triggers.at(name))
+			{
+			case SWITCH_SCENE:
 			{
-				QJsonObject jsonObject=jsonValue.toObject();
+				std::string sceneName=jsonObject.value(JSON_KEY_SCENE_NAME).toString().toStdString();
+				obs_source_release(FindScene(sceneName)); // validate before committing to it
+				target=sceneName;
+				switchTo=sceneName;
+				break;
+			}
+			case ENABLE_SOURCE:
+			case DISABLE_SOURCE:
+			{
+				std::string sourceName=jsonObject.value(JSON_KEY_SOURCE_NAME).toString().toStdString();
+				FindSource(target,sourceName);
+				changes[target][sourceName].visible=triggers.at(name) == ENABLE_SOURCE;
+				break;
+			}
+			case MOVE_SOURCE:
+			{
+				std::string sourceName=jsonObject.value(JSON_KEY_SOURCE_NAME).toString().toStdString();
+				vec2 position=Position(jsonObject.value(JSON_KEY_SOURCE_POSITION).toObject());
+				FindSource(target,sourceName);
+				changes[target][sourceName].position=position;
+				break;
+			}
+			}
+		}
+	}
 
-				// look for trigger name and bail if we don't recognize it
-				std::string name=jsonObject.value(JSON_KEY_SOURCE_TRIGGER).toString().toStdString();
-				Log("Trigger: "+name);
-				if (triggers.find(name) == triggers.end()) throw std::runtime_error("Unrecognized trigger received: "+name);
+	void Apply(void *data)
+	{
+		std::unique_ptr<std::vector<Pulse>> pulses(static_cast<std::vector<Pulse>*>(data));
+		std::vector<std::string> errors(pulses->size());
 
-				switch (triggers.at(name))
+		// walk every action in arrival order, letting later changes to the same source replace earlier ones
+		// item changes after a scene switch target the scene being switched to
+		std::optional<std::string> switchTo;
+		Staged changes;
+		try
+		{
+			std::string target=CurrentScene();
+			for (size_t pulseIndex=0; pulseIndex < pulses->size(); pulseIndex++)
+			{
+				// a pulse that fails partway leaves nothing behind, not even where it would have switched to
+				std::string pulseTarget=target;
+				std::optional<std::string> pulseSwitchTo;
+				Staged pulseChanges;
+				try
 				{
-				case SWITCH_SCENE:
+					Stage((*pulses)[pulseIndex],pulseTarget,pulseSwitchTo,pulseChanges);
+				}
+
+				catch (const std::runtime_error &exception)
 				{
-					SwitchScene(jsonObject.value(JSON_KEY_SCENE_NAME).toString().toStdString());
-					break;
+					Warn(exception.what());
+					errors[pulseIndex]=exception.what();
+					continue;
 				}
-				case ENABLE_SOURCE:
-					ShowSource(jsonObject.value(JSON_KEY_SOURCE_NAME).toString().toStdString());
-					break;
-				case DISABLE_SOURCE:
-					HideSource(jsonObject.value(JSON_KEY_SOURCE_NAME).toString().toStdString());
-					break;
-				case MOVE_SOURCE:
-					MoveSource(jsonObject.value(JSON_KEY_SOURCE_NAME).toString().toStdString(),jsonObject.value(JSON_KEY_SOURCE_POSITION).toObject());
-					break;
+
+				target=pulseTarget;
+				if (pulseSwitchTo) switchTo=pulseSwitchTo;
+				for (std::pair<const std::string,std::unordered_map<std::string,Change>> &scene : pulseChanges)
+				{
+					for (std::pair<const std::string,Change> &source : scene.second)
+					{
+						Change &merged=changes[scene.first][source.first];
+						if (source.second.visible) merged.visible=source.second.visible;
+						if (source.second.position) merged.position=source.second.position;
+					}
 				}
 			}
+
+			// every scene and item is looked up before the first one changes, so a lookup failing here leaves OBS untouched
+			std::vector<std::pair<SourcePtr,Changes>> updates;
+			for (std::pair<const std::string,std::unordered_map<std::string,Change>> &scene : changes)
+			{
+				Changes resolved;
+				for (std::pair<const std::string,Change> &source : scene.second) resolved.emplace_back(FindSource(scene.first,source.first),source.second);
+				updates.emplace_back(SourcePtr(FindScene(scene.first),&obs_source_release),std::move(resolved));
+			}
+			SourcePtr switchScene(switchTo ? FindScene(*switchTo) : nullptr,&obs_source_release);
+
+			for (std::pair<const std::string,std::unordered_map<std::string,Change>> &scene : changes)
+			{
+				for (std::pair<const std::string,Change> &source : scene.second) Log((source.second.visible ? (*source.second.visible ? "Show Source: " : "Hide Source: ") : "Move Source: ")+source.first);
+			}
+			for (std::pair<SourcePtr,Changes> &update : updates) obs_scene_atomic_update(obs_scene_from_source(update.first.get()),Update,&update.second);
+
+			if (switchTo)
+			{
+				Log("Switch Scene: "+*switchTo);
+				obs_frontend_set_current_scene(switchScene.get());
+				Feedback::SceneChanged(*switchTo); // the frontend event can arrive after the acknowledgement, so the client hears about it now
+			}
 		}
 
 		catch (const std::runtime_error &exception)
 		{
 			Warn(exception.what());
+			for (std::string &error : errors)
+			{
+				if (error.empty()) error=exception.what();
+			}
+		}
+
+		const uint64_t applied=os_gettime_ns();
+		for (size_t pulseIndex=0; pulseIndex < pulses->size(); pulseIndex++)
+		{
+			const Pulse &pulse=(*pulses)[pulseIndex];
+			if (pulse.socket) Acknowledge(pulse.socket,pulse.id,applied-pulse.received,errors[pulseIndex]);
+		}
+	}
+
+	void Tick(void *data,float seconds)
+	{
+		Q_UNUSED(data)
+		Q_UNUSED(seconds)
+		std::vector<Pulse> *batch=nullptr;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (queued.empty()) return;
+			batch=new std::vector<Pulse>(std::move(queued));
+			queued.clear();
+		}
+		obs_queue_task(OBS_TASK_UI,Apply,batch,false);
+	}
+}
+
+void Connection()
+{
+	Log("Incoming connection established");
+
+	QLocalSocket *socket=server->nextPendingConnection();
+	clients.emplace_back(socket);
+	Feedback::Send(socket,PulsarFrame::Encode(Feedback::Snapshot()));
+	std::shared_ptr<QByteArray> buffer=std::make_shared<QByteArray>();
+	socket->connect(socket,&QLocalSocket::readyRead,socket,[socket,buffer]() {
+		try
+		{
+			// a single read can hold several frames or only part of one
+			buffer->append(socket->readAll());
+			while (std::optional<QJsonObject> message=PulsarFrame::Decode(*buffer))
+			{
+				if (message->value(PULSAR_JSON_KEY_TYPE).toString() != PULSAR_MESSAGE_TYPE_PULSE) continue;
+
+				const qint64 id=message->value(PULSAR_JSON_KEY_ID).toInteger();
+				if (!enabled->isChecked())
+				{
+					Acknowledge(socket,id,0,{});
+					continue;
+				}
+				Batch::Queue({socket,id,message->value(PULSAR_JSON_KEY_ACTIONS).toArray(),os_gettime_ns()});
+			}
+		}
+
+		catch (const std::exception &exception)
+		{
+			Warn(exception.what());
+			socket->abort(); // framing is lost at this point, so the client has to reconnect
 		}
 	});
 	socket->connect(socket,&QLocalSocket::disconnected,socket,[socket]() {
+		std::erase_if(clients,[socket](const QPointer<QLocalSocket> &client) {
+			return !client || client == socket;
+		});
 		socket->deleteLater();
 	});
 }
@@ -184,6 +559,9 @@ void Connection()
 bool obs_module_load()
 {
 	obs_frontend_add_event_callback(HandleEvent,nullptr);
+	signal_handler_connect(obs_get_signal_handler(),"source_rename",Index::Invalidated,nullptr);
+	signal_handler_connect(obs_get_signal_handler(),"source_remove",Index::Invalidated,nullptr);
+	obs_add_tick_callback(Batch::Tick,nullptr);
 
 	server=new QLocalServer();
 	server->setSocketOptions(QLocalServer::UserAccessOption);
@@ -215,6 +593,15 @@ bool obs_module_load()
 void obs_module_unload()
 {
 	obs_frontend_remove_event_callback(HandleEvent,nullptr);
+	obs_remove_tick_callback(Batch::Tick,nullptr);
+	signal_handler_disconnect(obs_get_signal_handler(),"source_rename",Index::Invalidated,nullptr);
+	signal_handler_disconnect(obs_get_signal_handler(),"source_remove",Index::Invalidated,nullptr);
+	{
+		std::lock_guard<std::mutex> guard(Index::lock);
+		Index::Clear();
+	}
 	server->close();
 	server->deleteLater();
+	server=nullptr;
+	clients.clear();
 }
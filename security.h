@@ -15,12 +15,7 @@ inline const char *NETWORK_HEADER_CLIENT_ID="Client-Id";
 class PrivateSetting : public BasicSetting
 {
 public:
-	PrivateSetting(const QString &name,const QVariant &value=QVariant()) : BasicSetting("Private",qApp->applicationName(),name,value)
-	{
-		std::optional<QString> filePath=Filesystem::CreateHiddenFile(source->fileName());
-		if (!filePath) throw std::runtime_error("Could not create file for private settings");
-		source=std::make_shared<QSettings>(*filePath,source->format());
-	}
+	PrivateSetting(const QString &name,const QVariant &value=QVariant()) : BasicSetting(Settings::Store::Private(),qApp->applicationName(),name,value) { }
 };
 
 class Security final : public QObject
@@ -0,0 +1,99 @@
+#include "settings.h"
+
+const std::chrono::milliseconds SETTINGS_SAVE_DELAY=std::chrono::seconds(1);
+
+namespace Settings
+{
+	static quint64 revision=0;
+
+	Store::Store(std::unique_ptr<QSettings> source) : QObject(nullptr), source(std::move(source))
+	{
+		// writes are collected and flushed together rather than rewriting the file on every change
+		saveClock.setSingleShot(true);
+		saveClock.setInterval(TimeConvert::Interval(SETTINGS_SAVE_DELAY));
+		connect(&saveClock,&QTimer::timeout,this,&Store::Save);
+	}
+
+	Store::~Store()
+	{
+		Save();
+	}
+
+	std::shared_ptr<Entry> Store::Find(const QString &name)
+	{
+		if (auto candidate=entries.find(name); candidate != entries.end()) return candidate->second;
+
+		// if the setting is the word "true" or "false", convert the value to an actual boolean
+		// this is because everything is read in as a QString (https://stackoverflow.com/questions/32654233/qsettings-with-different-types)
+		// this is a problem because I'm relying on type information to differentiate between whether a value is false or nonexistent
+		// the conversion only happens in memory, so the file is left alone until something is actually set
+		QVariant value=source->value(name);
+		if (value.userType() == QMetaType::QString)
+		{
+			const QString text=value.toString();
+			if (text == "true") value=true;
+			if (text == "false") value=false;
+		}
+		return entries.try_emplace(name,std::make_shared<Entry>(Entry{.value=value,.revision=++revision})).first->second;
+	}
+
+	void Store::Set(const QString &name,const QVariant &value)
+	{
+		std::shared_ptr<Entry> entry=Find(name);
+		entry->value=value;
+		source->setValue(name,value);
+		Revise(*entry,name);
+	}
+
+	void Store::Unset(const QString &name)
+	{
+		std::shared_ptr<Entry> entry=Find(name);
+		entry->value=QVariant();
+		source->remove(name);
+		Revise(*entry,name);
+	}
+
+	void Store::Revise(Entry &entry,const QString &name)
+	{
+		entry.revision=++revision;
+		saveClock.start();
+		emit Changed(name);
+	}
+
+	void Store::Save()
+	{
+		saveClock.stop();
+		source->sync();
+	}
+
+	std::shared_ptr<Store> Store::Open(const QString &key,std::function<std::unique_ptr<QSettings>()> factory)
+	{
+		static std::unordered_map<QString,std::weak_ptr<Store>> stores;
+		std::weak_ptr<Store> &candidate=stores[key];
+		if (std::shared_ptr<Store> store=candidate.lock(); store) return store;
+		std::shared_ptr<Store> store=std::make_shared<Store>(factory());
+		candidate=store;
+		return store;
+	}
+
+	static QSettings::Format Format()
+	{
+		return Platform::Windows() ? QSettings::IniFormat : QSettings::NativeFormat;
+	}
+
+	std::shared_ptr<Store> Store::Application(const QString &applicationName)
+	{
+		return Open(u"application:%1"_s.arg(applicationName),[&applicationName]() {
+			return std::make_unique<QSettings>(Format(),QSettings::UserScope,qApp->organizationName(),applicationName);
+		});
+	}
+
+	std::shared_ptr<Store> Store::Private()
+	{
+		return Open(u"private"_s,[]() {
+			std::optional<QString> filePath=Filesystem::CreateHiddenFile(QSettings(Format(),QSettings::UserScope,qApp->organizationName(),u"Private"_s).fileName());
+			if (!filePath) throw std::runtime_error("Could not create file for private settings");
+			return std::make_unique<QSettings>(*filePath,Format());
+		});
+	}
+}
@@ -1,58 +1,114 @@
 #pragma once
 
+#include <QObject>
 #include <QSettings>
+#include <QTimer>
 #include <QColor>
 #include <QSize>
+#include <QUrl>
 #include <QApplication>
+#include <unordered_map>
+#include <functional>
 #include <memory>
 #include "globals.h"
 
+namespace Settings
+{
+	struct Entry
+	{
+		QVariant value;
+		quint64 revision;
+	};
+
+	// one of these exists per settings file no matter how many settings point at it
+	// settings are only touched from the GUI thread, so nothing here is locked
+	class Store : public QObject
+	{
+		Q_OBJECT
+	public:
+		Store(std::unique_ptr<QSettings> source);
+		~Store();
+		std::shared_ptr<Entry> Find(const QString &name);
+		void Set(const QString &name,const QVariant &value);
+		void Unset(const QString &name);
+		void Save();
+		static std::shared_ptr<Store> Application(const QString &applicationName);
+		static std::shared_ptr<Store> Private();
+	protected:
+		std::unique_ptr<QSettings> source;
+		std::unordered_map<QString,std::shared_ptr<Entry>> entries;
+		QTimer saveClock;
+		void Revise(Entry &entry,const QString &name);
+		static std::shared_ptr<Store> Open(const QString &key,std::function<std::unique_ptr<QSettings>()> factory);
+	signals:
+		void Changed(const QString &name);
+	};
+}
+
 class BasicSetting
 {
 public:
-	BasicSetting(const QString &applicationName,const QString &category,const QString &name,const QVariant &defaultValue=QVariant()) : name(QString("%1/%2").arg(category,name)), defaultValue(defaultValue), source(std::make_shared<QSettings>(Platform::Windows() ? QSettings::IniFormat : QSettings::NativeFormat,QSettings::UserScope,qApp->organizationName(),applicationName))
-	{
-		// if the setting is the word "true" or "false", convert the value to an actual boolean
-		// this is because everything is read in as a QString (https://stackoverflow.com/questions/32654233/qsettings-with-different-types)
-		// this is a problem because I'm relying on type information to differentiate between whether a value is false or nonexistent
-		// this hack will have unintended side-effects that may become a problem later
-		QString text=Value().toString();
-		if (text == "true")	Set(true);
-		if (text == "false") Set(false);
-	}
+	BasicSetting(std::shared_ptr<Settings::Store> store,const QString &category,const QString &name,const QVariant &defaultValue=QVariant()) : name(QString("%1/%2").arg(category,name)), defaultValue(defaultValue), store(store), entry(store->Find(this->name)), revision(0) { }
 	const QString Name() const { return name; }
-	void Save() { source->sync(); }
-	const QVariant Value() const { return source->value(name,defaultValue); }
-	void Set(const QVariant &value) { source->setValue(name,value); }
-	void Unset() { source->remove(name); }
-	operator bool() const
+	void Save() { store->Save(); }
+	const QVariant Value() const { return entry->value.isValid() ? entry->value : defaultValue; }
+	void Set(const QVariant &value) { store->Set(name,value); }
+	void Unset() { store->Unset(name); }
+	QMetaObject::Connection Watch(QObject *context,std::function<void()> callback) const
 	{
-		const QVariant candidate=Value();
-		if (!candidate.isValid()) return false; // setting does not appear in file, no default value
-		if (Value().userType() == QMetaType::Bool) return candidate.toBool(); // setting appears in file and it a boolean
-		return true; // setting appears in file
+		return QObject::connect(store.get(),&Settings::Store::Changed,context,[name=name,callback](const QString &changed) {
+			if (changed == name) callback();
+		});
 	}
-	operator QString() const { return Value().toString(); }
-	operator unsigned int() const { return Value().toUInt(); }
-	operator int() const { return Value().toInt(); }
-	operator quint16() const { return Value().toUInt(); }
-	operator qint64() const { return Value().toLongLong(); }
-	operator qreal() const { return Value().toReal(); }
-	operator std::chrono::milliseconds() const { return std::chrono::milliseconds(Value().toUInt()); }
-	operator std::chrono::seconds() const { return std::chrono::seconds(Value().toUInt()); }
-	operator QColor() const { return source->value(name,defaultValue).value<QColor>(); }
-	operator QSize() const { return source->value(name,defaultValue).toSize(); }
-	operator QByteArray() const { return Value().toString().toLocal8Bit(); }
+	operator bool() const { return Converted().present; }
+	operator QString() const { return Converted().text; }
+	operator unsigned int() const { return Converted().natural; }
+	operator int() const { return Converted().integer; }
+	operator quint16() const { return Converted().natural; }
+	operator qint64() const { return Converted().wide; }
+	operator qreal() const { return Converted().real; }
+	operator std::chrono::milliseconds() const { return std::chrono::milliseconds(Converted().natural); }
+	operator std::chrono::seconds() const { return std::chrono::seconds(Converted().natural); }
+	operator QColor() const { return Value().value<QColor>(); }
+	operator QSize() const { return Value().toSize(); }
+	operator QByteArray() const { return Converted().text.toLocal8Bit(); }
 	operator QUrl() const { return Value().toUrl(); }
 protected:
+	struct Conversions
+	{
+		bool present;
+		QString text;
+		int integer;
+		unsigned int natural;
+		qint64 wide;
+		qreal real;
+	};
 	QString name;
 	QVariant defaultValue;
-	std::shared_ptr<QSettings> source;
+	std::shared_ptr<Settings::Store> store;
+	std::shared_ptr<Settings::Entry> entry;
+	mutable Conversions conversions;
+	mutable quint64 revision;
+	const Conversions& Converted() const
+	{
+		// conversions are redone only when the value changes, so hot paths pay for an integer comparison instead of a QVariant conversion
+		if (revision == entry->revision) return conversions;
+		const QVariant candidate=Value();
+		conversions={
+			.present=!candidate.isValid() ? false : candidate.userType() == QMetaType::Bool ? candidate.toBool() : true, // absent with no default, a boolean, or simply present
+			.text=candidate.toString(),
+			.integer=candidate.toInt(),
+			.natural=candidate.toUInt(),
+			.wide=candidate.toLongLong(),
+			.real=candidate.toReal()
+		};
+		revision=entry->revision;
+		return conversions;
+	}
 };
 
 class ApplicationSetting : public BasicSetting
 {
 public:
-	ApplicationSetting(const QString &category,const QString &name,const QVariant &value=QVariant()) : BasicSetting(qApp->applicationName(),category,name,value) { }
+	ApplicationSetting(const QString &category,const QString &name,const QVariant &value=QVariant()) : BasicSetting(Settings::Store::Application(qApp->applicationName()),category,name,value) { }
 };
-
@@ -0,0 +1,184 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QtEndian>
+#include "snapshot.h"
+#include "globals.h"
+
+const char *SNAPSHOT_FILENAME="celeste.snapshot";
+const char *SNAPSHOT_MAGIC="CLST";
+const char *SNAPSHOT_KEY_SOURCE="source";
+const char *SNAPSHOT_KEY_DATA="data";
+const char *SNAPSHOT_KEY_MODIFIED="modified";
+const char *SNAPSHOT_KEY_SIZE="size";
+const std::chrono::milliseconds SNAPSHOT_REGENERATE_DELAY=std::chrono::seconds(2);
+const qsizetype SNAPSHOT_HEADER_SIZE=8; // magic followed by a big-endian version
+
+const quint32 Snapshot::VERSION=1;
+
+Snapshot::Snapshot(QObject *parent) : QObject(parent),
+	filePath(Filesystem::DataPath().filePath(SNAPSHOT_FILENAME)),
+	regenerating(false),
+	dirty(false)
+{
+	// saving a file usually touches it more than once, so changes are collected before rebuilding
+	pool.setMaxThreadCount(1);
+	regenerateClock.setSingleShot(true);
+	regenerateClock.setInterval(TimeConvert::Interval(SNAPSHOT_REGENERATE_DELAY));
+	connect(&regenerateClock,&QTimer::timeout,this,&Snapshot::Regenerate);
+	connect(&watcher,&QFileSystemWatcher::fileChanged,this,[this](const QString &path) {
+		Watch(path); // editors that replace the file drop it from the watcher
+		regenerateClock.start();
+	});
+}
+
+void Snapshot::Open()
+{
+	static const char *OPERATION="open snapshot";
+
+	QFile file(filePath);
+	if (!file.exists() || !file.open(QIODevice::ReadOnly)) return;
+
+	// map rather than read so the file's pages are decoded in place instead of copied first
+	const qint64 size=file.size();
+	uchar *data=size > SNAPSHOT_HEADER_SIZE ? file.map(0,size) : nullptr;
+	if (!data)
+	{
+		emit Print(u"Failed to map snapshot file: %1"_s.arg(file.fileName()),OPERATION);
+		return;
+	}
+
+	QElapsedTimer clock;
+	clock.start();
+	if (QByteArray::fromRawData(reinterpret_cast<const char*>(data),4) != SNAPSHOT_MAGIC || qFromBigEndian<quint32>(data+4) != VERSION)
+	{
+		emit Print(u"Snapshot is from a different version of Celeste and will be rebuilt"_s,OPERATION);
+	}
+	else
+	{
+		QCborParserError error;
+		const QCborValue root=QCborValue::fromCbor(QByteArray::fromRawData(reinterpret_cast<const char*>(data+SNAPSHOT_HEADER_SIZE),size-SNAPSHOT_HEADER_SIZE),&error);
+		if (error.error != QCborError::NoError || !root.isMap())
+			emit Print(u"Snapshot is corrupt and will be rebuilt: %1"_s.arg(error.errorString()),OPERATION);
+		else
+			sections=root.toMap();
+	}
+	file.unmap(data);
+	emit Print(u"Loaded %1 sections in %2ms"_s.arg(StringConvert::PositiveInteger(static_cast<unsigned int>(sections.size())),QString::number(clock.elapsed())),OPERATION);
+}
+
+void Snapshot::Section(const QString &name,const QString &sourcePath,Builder builder)
+{
+	sources.insert_or_assign(name,Source{.path=sourcePath,.builder=builder});
+	Watch(sourcePath);
+}
+
+std::optional<QCborValue> Snapshot::Find(const QString &name)
+{
+	const QCborMap section=sections.value(name).toMap();
+	if (auto source=sources.find(name); source != sources.end())
+	{
+		if (section.isEmpty() || section.value(SNAPSHOT_KEY_SOURCE).toMap() != Stamp(source->second.path))
+		{
+			// the caller falls back to the JSON, and the next launch gets a fresh copy
+			dirty=true;
+			regenerateClock.start();
+			return std::nullopt;
+		}
+	}
+	if (!section.contains(QString(SNAPSHOT_KEY_DATA))) return std::nullopt;
+	return section.value(SNAPSHOT_KEY_DATA);
+}
+
+void Snapshot::Store(const QString &name,const QCborValue &value)
+{
+	sections.insert(name,QCborMap{{SNAPSHOT_KEY_DATA,value}});
+	dirty=true;
+	regenerateClock.start();
+}
+
+void Snapshot::Watch(const QString &path)
+{
+	if (QFileInfo::exists(path) && !watcher.files().contains(path)) watcher.addPath(path);
+}
+
+QCborMap Snapshot::Stamp(const QString &path)
+{
+	const QFileInfo details(path);
+	if (!details.exists()) return {};
+	return {
+		{SNAPSHOT_KEY_MODIFIED,details.lastModified().toMSecsSinceEpoch()},
+		{SNAPSHOT_KEY_SIZE,details.size()}
+	};
+}
+
+void Snapshot::Regenerate()
+{
+	if (regenerating)
+	{
+		regenerateClock.start();
+		return;
+	}
+	regenerating=true;
+	dirty=false;
+
+	// sections without a source file (downloaded data) are carried over as they are
+	QCborMap carried;
+	for (auto section=sections.begin(); section != sections.end(); ++section)
+	{
+		if (sources.find(section.key().toString()) == sources.end()) carried.insert(section.key(),section.value());
+	}
+
+	pool.start([this,sources=sources,carried,filePath=filePath]() {
+		QElapsedTimer clock;
+		clock.start();
+		QCborMap rebuilt=carried;
+		QStringList failures;
+		for (const std::pair<const QString,Source> &source : sources)
+		{
+			// stamp before reading, so a write that lands mid-read leaves the section stale rather than wrong
+			const QCborMap stamp=Stamp(source.second.path);
+			QFile file(source.second.path);
+			if (stamp.isEmpty() || !file.open(QIODevice::ReadOnly)) continue;
+			const QCborValue data=source.second.builder(file.readAll());
+			if (data.isInvalid())
+			{
+				failures.append(source.first);
+				continue;
+			}
+			rebuilt.insert(source.first,QCborMap{
+				{SNAPSHOT_KEY_SOURCE,stamp},
+				{SNAPSHOT_KEY_DATA,data}
+			});
+		}
+
+		QByteArray header(SNAPSHOT_MAGIC,4);
+		header.resize(SNAPSHOT_HEADER_SIZE);
+		qToBigEndian<quint32>(VERSION,header.data()+4);
+		QSaveFile file(filePath);
+		const bool saved=file.open(QIODevice::WriteOnly) && file.write(header) == SNAPSHOT_HEADER_SIZE && file.write(QCborValue(rebuilt).toCbor()) > 0 && file.commit();
+		const qint64 duration=clock.elapsed();
+
+		QMetaObject::invokeMethod(this,[this,rebuilt,failures,saved,duration]() {
+			static const char *OPERATION="regenerate snapshot";
+			for (const QString &failure : failures) emit Print(u"Source for %1 could not be parsed, so it was left out"_s.arg(failure),OPERATION);
+			if (saved)
+			{
+				// downloaded sections may have been replaced while this was running, so only sourced ones are taken
+				for (auto section=rebuilt.begin(); section != rebuilt.end(); ++section)
+				{
+					if (sources.find(section.key().toString()) != sources.end()) sections.insert(section.key(),section.value());
+				}
+				emit Print(u"Rebuilt snapshot in %1ms"_s.arg(QString::number(duration)),OPERATION);
+			}
+			else
+			{
+				emit Print(u"Failed to write snapshot file"_s,OPERATION);
+			}
+			regenerating=false;
+			if (dirty) regenerateClock.start();
+		},Qt::QueuedConnection);
+	});
+}
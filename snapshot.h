@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QObject>
+#include <QCborValue>
+#include <QCborMap>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QThreadPool>
+#include <unordered_map>
+#include <functional>
+#include <optional>
+
+// pre-built copies of the data files Celeste loads at launch, kept in one versioned binary file
+// the JSON files stay the source of truth; a section is only used while its source is unchanged,
+// and any change to a source rebuilds the snapshot in the background
+class Snapshot : public QObject
+{
+	Q_OBJECT
+public:
+	using Builder=std::function<QCborValue(const QByteArray &source)>;
+	Snapshot(QObject *parent=nullptr);
+	void Section(const QString &name,const QString &sourcePath,Builder builder);
+	std::optional<QCborValue> Find(const QString &name);
+	void Store(const QString &name,const QCborValue &value);
+	void Open();
+	static const quint32 VERSION;
+protected:
+	struct Source
+	{
+		QString path;
+		Builder builder;
+	};
+	QString filePath;
+	QCborMap sections;
+	std::unordered_map<QString,Source> sources;
+	QFileSystemWatcher watcher;
+	QTimer regenerateClock;
+	bool regenerating;
+	bool dirty;
+	QThreadPool pool; // last, so it's destroyed first and waits for a rebuild in progress
+	void Regenerate();
+	void Watch(const QString &path);
+	static QCborMap Stamp(const QString &path);
+signals:
+	void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("snapshot"));
+};
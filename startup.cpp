@@ -0,0 +1,131 @@
+#include <algorithm>
+#include "startup.h"
+#include "globals.h"
+
+Startup::Startup(QObject *parent) : QObject(parent), running(false)
+{
+	clock.start();
+}
+
+void Startup::Stage(const QString &name,const QStringList &dependencies,std::function<void()> action)
+{
+	stages.push_back({
+		.name=name,
+		.dependencies=dependencies,
+		.action=action,
+		.started=std::nullopt,
+		.finished=std::nullopt
+	});
+	if (running) Advance();
+}
+
+void Startup::Task(const QString &name,const QStringList &dependencies,std::function<void()> action)
+{
+	Stage(name,dependencies,[this,name,action]() {
+		action();
+		Finish(name);
+	});
+}
+
+void Startup::Start()
+{
+	running=true;
+	Advance();
+}
+
+void Startup::Finish(const QString &name)
+{
+	Record *stage=Find(name);
+	if (!stage || stage->finished) return;
+	if (!stage->started) stage->started=Elapsed();
+	stage->finished=Elapsed();
+	emit Print(u"Finished %1 after %2ms"_s.arg(name,QString::number(*stage->finished-*stage->started)),u"finish stage"_s);
+	if (running) Advance();
+}
+
+bool Startup::Finished(const QString &name) const
+{
+	const Record *stage=Find(name);
+	return stage && stage->finished;
+}
+
+qint64 Startup::Elapsed() const
+{
+	return clock.elapsed();
+}
+
+Startup::Record* Startup::Find(const QString &name)
+{
+	for (Record &stage : stages)
+	{
+		if (stage.name == name) return &stage;
+	}
+	return nullptr;
+}
+
+const Startup::Record* Startup::Find(const QString &name) const
+{
+	return const_cast<Startup*>(this)->Find(name);
+}
+
+void Startup::Advance()
+{
+	// indices rather than iterators because an action can declare more stages
+	bool pending=false;
+	for (size_t index=0; index < stages.size(); index++)
+	{
+		if (stages[index].started)
+		{
+			if (!stages[index].finished) pending=true;
+			continue;
+		}
+
+		bool ready=true;
+		for (const QString &dependency : stages[index].dependencies)
+		{
+			if (!Finished(dependency)) ready=false;
+		}
+		if (!ready)
+		{
+			pending=true;
+			continue;
+		}
+
+		stages[index].started=Elapsed();
+		if (std::function<void()> action=stages[index].action; action) action(); // copied because the action can reallocate the list
+		if (!stages[index].finished) pending=true;
+	}
+
+	if (!pending && running)
+	{
+		running=false;
+		Report();
+		emit Ready();
+	}
+}
+
+void Startup::Report()
+{
+	static const char *OPERATION="timeline";
+
+	std::vector<const Record*> timeline;
+	for (const Record &stage : stages) timeline.push_back(&stage);
+	std::sort(timeline.begin(),timeline.end(),[](const Record *left,const Record *right) {
+		return *left->started < *right->started;
+	});
+
+	qint64 total=0;
+	for (const Record *stage : timeline)
+	{
+		emit Print(u"%1: %2ms to %3ms"_s.arg(stage->name,QString::number(*stage->started),QString::number(*stage->finished)),OPERATION);
+		total=std::max(total,*stage->finished);
+	}
+	emit Print(u"Startup finished after %1ms"_s.arg(QString::number(total)),OPERATION);
+}
+
+void Startup::MessageHandled()
+{
+	if (firstMessage) return;
+	firstMessage=Elapsed();
+	emit Print(u"First chat message handled %1ms after launch"_s.arg(QString::number(*firstMessage)),u"time to first message"_s);
+}
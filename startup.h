@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <functional>
+#include <optional>
+#include <vector>
+
+// runs each stage once everything it depends on has finished and keeps a timeline of when they ran
+// stages that wait on the network return immediately and call Finish() from a signal later,
+// which lets independent stages overlap instead of waiting in line
+class Startup : public QObject
+{
+	Q_OBJECT
+public:
+	Startup(QObject *parent=nullptr);
+	void Stage(const QString &name,const QStringList &dependencies,std::function<void()> action);
+	void Task(const QString &name,const QStringList &dependencies,std::function<void()> action);
+	template <typename Sender,typename Signal> void FinishOn(const QString &name,const Sender *sender,Signal signal)
+	{
+		connect(sender,signal,this,[this,name]() { Finish(name); },Qt::SingleShotConnection);
+	}
+	void Start();
+	void Finish(const QString &name);
+	bool Finished(const QString &name) const;
+	qint64 Elapsed() const;
+protected:
+	struct Record
+	{
+		QString name;
+		QStringList dependencies;
+		std::function<void()> action;
+		std::optional<qint64> started;
+		std::optional<qint64> finished;
+	};
+	QElapsedTimer clock;
+	std::vector<Record> stages;
+	std::optional<qint64> firstMessage;
+	bool running;
+	Record* Find(const QString &name);
+	const Record* Find(const QString &name) const;
+	void Advance();
+	void Report();
+signals:
+	void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("startup"));
+	void Ready();
+public slots:
+	void MessageHandled();
+};
@@ -0,0 +1,257 @@
+#include <QCoreApplication>
+#include <QThread>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include "globals.h"
+#include "trace.h"
+#include "metrics.h"
+
+const size_t TRACE_RING_CAPACITY=32768;
+const char *TRACE_JSON_KEY_EVENTS="traceEvents";
+const char *TRACE_JSON_KEY_TIME_UNIT="displayTimeUnit";
+const char *TRACE_JSON_KEY_NAME="name";
+const char *TRACE_JSON_KEY_CATEGORY="cat";
+const char *TRACE_JSON_KEY_PHASE="ph";
+const char *TRACE_JSON_KEY_TIMESTAMP="ts";
+const char *TRACE_JSON_KEY_DURATION="dur";
+const char *TRACE_JSON_KEY_PROCESS="pid";
+const char *TRACE_JSON_KEY_THREAD="tid";
+const char *TRACE_JSON_KEY_SCOPE="s";
+const char *TRACE_JSON_KEY_ARGUMENTS="args";
+const char *TRACE_JSON_KEY_DETAIL="detail";
+const char *TRACE_PHASE_COMPLETE="X";
+const char *TRACE_PHASE_INSTANT="i";
+const char *TRACE_PHASE_METADATA="M";
+const char *TRACE_SCOPE_THREAD="t";
+const char *TRACE_METADATA_THREAD_NAME="thread_name";
+const char *TRACE_CATEGORY_CORRELATION="correlation";
+
+namespace Trace
+{
+	struct Event
+	{
+		const char *category;
+		const char *name;
+		qint64 start; // in nanoseconds since the epoch below
+		qint64 duration; // negative for instant events
+		QString detail;
+	};
+
+	// only its own thread writes to a ring, so the lock is uncontended except while a dump copies it out
+	struct Ring
+	{
+		std::mutex mutex;
+		std::vector<Event> events;
+		size_t next;
+		bool wrapped;
+		int thread;
+		QString threadName;
+	};
+
+	static const Clock::time_point epoch=Clock::now();
+
+	static std::mutex& RingsLock()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	// rings outlive their threads so a dump still shows work done on a thread that has since finished
+	static std::vector<std::shared_ptr<Ring>>& Rings()
+	{
+		static std::vector<std::shared_ptr<Ring>> rings;
+		return rings;
+	}
+
+	static Ring& Local()
+	{
+		thread_local std::shared_ptr<Ring> ring=[]() {
+			std::shared_ptr<Ring> ring=std::make_shared<Ring>();
+			ring->events.resize(TRACE_RING_CAPACITY);
+			ring->next=0;
+			ring->wrapped=false;
+			QThread *thread=QThread::currentThread();
+			ring->threadName=!thread->objectName().isEmpty() ? thread->objectName() : qApp && thread == qApp->thread() ? u"main"_s : QString();
+			std::lock_guard<std::mutex> lock(RingsLock());
+			ring->thread=static_cast<int>(Rings().size())+1;
+			if (ring->threadName.isEmpty()) ring->threadName=u"thread %1"_s.arg(ring->thread);
+			Rings().push_back(ring);
+			return ring;
+		}();
+		return *ring;
+	}
+
+	static qint64 Nanoseconds(Clock::time_point time)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(time-epoch).count();
+	}
+
+	static void Record(Event &&event)
+	{
+		Ring &ring=Local();
+		std::lock_guard<std::mutex> lock(ring.mutex);
+		ring.events[ring.next]=std::move(event);
+		if (++ring.next == ring.events.size())
+		{
+			ring.next=0;
+			ring.wrapped=true;
+		}
+	}
+
+	void Enable(bool enable)
+	{
+		if (enable) enabled.store(true,std::memory_order_relaxed);
+		Instant("trace",enable ? "enabled" : "disabled");
+		if (!enable) enabled.store(false,std::memory_order_relaxed);
+	}
+
+	void Complete(const char *category,const char *name,Clock::time_point start,const QString &detail)
+	{
+		if (!Enabled()) return;
+		const Clock::time_point end=Clock::now();
+		Record({
+			.category=category,
+			.name=name,
+			.start=Nanoseconds(start),
+			.duration=std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count(),
+			.detail=detail
+		});
+	}
+
+	void Instant(const char *category,const char *name,const QString &detail)
+	{
+		if (!Enabled()) return;
+		Record({
+			.category=category,
+			.name=name,
+			.start=Nanoseconds(Clock::now()),
+			.duration=-1,
+			.detail=detail
+		});
+	}
+
+	qsizetype Dump(const QString &filePath,std::chrono::seconds window)
+	{
+		const qint64 cutoff=Nanoseconds(Clock::now())-std::chrono::duration_cast<std::chrono::nanoseconds>(window).count();
+		const qint64 process=QCoreApplication::applicationPid();
+
+		std::vector<std::shared_ptr<Ring>> rings;
+		{
+			std::lock_guard<std::mutex> lock(RingsLock());
+			rings=Rings();
+		}
+
+		QJsonArray events;
+		qsizetype count=0;
+		for (const std::shared_ptr<Ring> &ring : rings)
+		{
+			events.append(QJsonObject{
+				{TRACE_JSON_KEY_NAME,TRACE_METADATA_THREAD_NAME},
+				{TRACE_JSON_KEY_PHASE,TRACE_PHASE_METADATA},
+				{TRACE_JSON_KEY_PROCESS,process},
+				{TRACE_JSON_KEY_THREAD,ring->thread},
+				{TRACE_JSON_KEY_ARGUMENTS,QJsonObject{{TRACE_JSON_KEY_NAME,ring->threadName}}}
+			});
+
+			std::lock_guard<std::mutex> lock(ring->mutex);
+			const size_t size=ring->wrapped ? ring->events.size() : ring->next;
+			const size_t first=ring->wrapped ? ring->next : 0;
+			for (size_t offset=0; offset < size; offset++)
+			{
+				const Event &event=ring->events[(first+offset)%ring->events.size()];
+				if (event.start+std::max<qint64>(event.duration,0) < cutoff) continue;
+				QJsonObject object{
+					{TRACE_JSON_KEY_NAME,event.name},
+					{TRACE_JSON_KEY_CATEGORY,event.category},
+					{TRACE_JSON_KEY_PROCESS,process},
+					{TRACE_JSON_KEY_THREAD,ring->thread},
+					{TRACE_JSON_KEY_TIMESTAMP,static_cast<double>(event.start)/1000.0}
+				};
+				if (event.duration < 0)
+				{
+					object.insert(TRACE_JSON_KEY_PHASE,TRACE_PHASE_INSTANT);
+					object.insert(TRACE_JSON_KEY_SCOPE,TRACE_SCOPE_THREAD);
+				}
+				else
+				{
+					object.insert(TRACE_JSON_KEY_PHASE,TRACE_PHASE_COMPLETE);
+					object.insert(TRACE_JSON_KEY_DURATION,static_cast<double>(event.duration)/1000.0);
+				}
+				if (!event.detail.isEmpty()) object.insert(TRACE_JSON_KEY_ARGUMENTS,QJsonObject{{TRACE_JSON_KEY_DETAIL,event.detail}});
+				events.append(object);
+				count++;
+			}
+		}
+
+		if (!QDir().mkpath(QFileInfo(filePath).absolutePath())) throw std::runtime_error("Failed to create directory for trace file");
+		QSaveFile file(filePath);
+		if (!file.open(QIODevice::WriteOnly)) throw std::runtime_error("Failed to open trace file: "+file.errorString().toStdString());
+		file.write(QJsonDocument(QJsonObject{
+			{TRACE_JSON_KEY_EVENTS,events},
+			{TRACE_JSON_KEY_TIME_UNIT,"ms"}
+		}).toJson(QJsonDocument::Compact));
+		if (!file.commit()) throw std::runtime_error("Failed to write trace file: "+file.errorString().toStdString());
+		return count;
+	}
+
+	static std::atomic<quint64> nextCorrelation { 1 };
+	static thread_local std::shared_ptr<Correlation> currentCorrelation;
+
+	Correlation::Correlation(const char *type) : id(nextCorrelation.fetch_add(1,std::memory_order_relaxed)), type(type), start(Clock::now()), hopsRecorded(false)
+	{
+		hops.reserve(8);
+		if (Enabled()) Instant(TRACE_CATEGORY_CORRELATION,"begin",u"#%1 %2"_s.arg(QString::number(id),type)); // every chat line gets here, so skip building the detail unless it's going somewhere
+	}
+
+	void Correlation::Hop(const char *name)
+	{
+		hops.push_back({name,Clock::now()});
+		if (Enabled()) Instant(TRACE_CATEGORY_CORRELATION,name,u"#%1 %2"_s.arg(QString::number(id),type));
+	}
+
+	void Correlation::Finish(const char *stage)
+	{
+		Metrics::FindHistogram(u"celeste_event_latency_seconds"_s,u"Time from an inbound chat line or EventSub notification to its pane being shown or finishing"_s,{{u"type"_s,type},{u"stage"_s,stage}}).Record(start);
+		if (Enabled()) Instant(TRACE_CATEGORY_CORRELATION,stage,u"#%1 %2"_s.arg(QString::number(id),type));
+
+		// an event that raises several panes would otherwise count its hops once per pane
+		if (hopsRecorded) return;
+		hopsRecorded=true;
+		Clock::time_point previous=start;
+		for (const std::pair<const char*,Clock::time_point> &hop : hops)
+		{
+			Metrics::FindHistogram(u"celeste_event_hop_seconds"_s,u"Time spent reaching each step on the way from an inbound event to a pane"_s,{{u"type"_s,type},{u"hop"_s,hop.first}}).Record(std::chrono::duration_cast<std::chrono::microseconds>(hop.second-previous));
+			previous=hop.second;
+		}
+	}
+
+	std::shared_ptr<Correlation> Correlation::Current()
+	{
+		return currentCorrelation;
+	}
+
+	std::shared_ptr<Correlation> Correlation::Begin(const char *type)
+	{
+		return std::make_shared<Correlation>(type);
+	}
+
+	Correlation::Scope::Scope(std::shared_ptr<Correlation> correlation,const char *hop) : previous(std::move(currentCorrelation))
+	{
+		if (correlation && hop) correlation->Hop(hop);
+		currentCorrelation=std::move(correlation);
+	}
+
+	Correlation::Scope::~Scope()
+	{
+		currentCorrelation=std::move(previous);
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QString>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <memory>
+#include <vector>
+
+// records spans and instant events into a ring buffer per thread and writes them out in the Chrome trace event format,
+// which chrome://tracing and ui.perfetto.dev both open; while tracing is off, a span costs one atomic load
+namespace Trace
+{
+	using Clock=std::chrono::steady_clock;
+
+	inline std::atomic<bool> enabled { false };
+
+	inline bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+	void Enable(bool enable);
+	void Complete(const char *category,const char *name,Clock::time_point start,const QString &detail=QString());
+	void Instant(const char *category,const char *name,const QString &detail=QString());
+	qsizetype Dump(const QString &filePath,std::chrono::seconds window);
+
+	class Span
+	{
+	public:
+		Span(const char *category,const char *name,const QString &detail=QString()) : category(category), name(name), detail(Enabled() ? detail : QString()), start(Enabled() ? std::optional<Clock::time_point>(Clock::now()) : std::nullopt) { }
+		~Span() { if (start) Complete(category,name,*start,detail); }
+		Span(const Span &other)=delete;
+		Span& operator=(const Span &other)=delete;
+	protected:
+		const char *category;
+		const char *name;
+		QString detail;
+		std::optional<Clock::time_point> start;
+	};
+
+	// follows one inbound event, an IRC line or an EventSub notification, through the signals it sets off
+	// the current one is ambient while its handlers run directly, and anything that continues later
+	// (a network lookup, a queued pane) keeps the pointer and reinstates it with a Scope
+	class Correlation
+	{
+	public:
+		Correlation(const char *type);
+		quint64 ID() const { return id; }
+		const char* Type() const { return type; }
+		void Retype(const char *type) { this->type=type; }
+		void Hop(const char *name);
+		void Finish(const char *stage);
+		static std::shared_ptr<Correlation> Begin(const char *type);
+		static std::shared_ptr<Correlation> Current();
+
+		class Scope
+		{
+		public:
+			Scope(std::shared_ptr<Correlation> correlation,const char *hop=nullptr);
+			~Scope();
+			Scope(const Scope &other)=delete;
+			Scope& operator=(const Scope &other)=delete;
+		protected:
+			std::shared_ptr<Correlation> previous;
+		};
+	protected:
+		quint64 id;
+		const char *type;
+		Clock::time_point start;
+		std::vector<std::pair<const char*,Clock::time_point>> hops;
+		bool hopsRecorded;
+	};
+}
@@ -0,0 +1,55 @@
+#include <QCache>
+#include <QFontMetrics>
+#include "typesetting.h"
+#include "globals.h"
+
+namespace Typesetting
+{
+	const int FIT_CACHE_SIZE=1024;
+
+	static QCache<QString,int> fits(FIT_CACHE_SIZE);
+
+	static int Width(QFont font,int pointSize,const QString &text)
+	{
+		font.setPointSize(pointSize);
+		return QFontMetrics{font}.boundingRect(text).width();
+	}
+
+	int FitPointSize(const QFont &font,const QString &text,int maxPixels)
+	{
+		// QFont::key() covers family, style, and point size, which is everything besides text and width that changes the result
+		const QString key=QString("%1|%2|%3").arg(font.key(),StringConvert::Integer(maxPixels),text);
+		if (const int *pointSize=fits.object(key); pointSize) return *pointSize;
+
+		const int pointSize=SearchPointSize(font,text,maxPixels);
+		fits.insert(key,new int(pointSize));
+		return pointSize;
+	}
+
+	int SearchPointSize(const QFont &font,const QString &text,int maxPixels)
+	{
+		const int originalPointSize=font.pointSize();
+		int pointSize=originalPointSize;
+		if (originalPointSize > 1 && Width(font,originalPointSize,text) > maxPixels)
+		{
+			int fit=0;
+			int low=1;
+			int high=originalPointSize-1;
+			while (low <= high)
+			{
+				int middle=low+(high-low)/2;
+				if (Width(font,middle,text) <= maxPixels)
+				{
+					fit=middle;
+					low=middle+1;
+				}
+				else
+				{
+					high=middle-1;
+				}
+			}
+			if (fit > 0) pointSize=fit;
+		}
+		return pointSize;
+	}
+}
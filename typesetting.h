@@ -0,0 +1,10 @@
+#pragma once
+
+#include <QFont>
+#include <QString>
+
+namespace Typesetting
+{
+	int FitPointSize(const QFont &font,const QString &text,int maxPixels);
+	int SearchPointSize(const QFont &font,const QString &text,int maxPixels); // the search behind FitPointSize, without the cache
+}
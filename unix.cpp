@@ -1,6 +1,13 @@
 #include <QFileInfo>
 #include <QDir>
+#include <csignal>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <pthread.h>
+#include <execinfo.h>
 #include "globals.h"
+#include "watchdog.h"
 
 namespace Filesystem
 {
@@ -14,3 +21,56 @@ namespace Filesystem
 		return file.fileName();
 	}
 }
+
+namespace Platform
+{
+	const int STACK_CAPTURE_SIGNAL=SIGUSR2;
+	const int STACK_CAPTURE_DEPTH=64;
+
+	static pthread_t guiThread;
+	static void *stackFrames[STACK_CAPTURE_DEPTH];
+	static std::atomic<int> stackFrameCount { -1 };
+
+	static void StackCaptureHandler(int)
+	{
+		// runs on the GUI thread, interrupting whatever it was stuck in
+		stackFrameCount.store(backtrace(stackFrames,STACK_CAPTURE_DEPTH),std::memory_order_release);
+	}
+
+	void PrepareStackCapture()
+	{
+		guiThread=pthread_self();
+
+		// backtrace loads libgcc the first time it's called, which must not happen inside a signal handler
+		void *frame=nullptr;
+		backtrace(&frame,1);
+
+		struct sigaction action {};
+		action.sa_handler=StackCaptureHandler;
+		sigemptyset(&action.sa_mask);
+		action.sa_flags=SA_RESTART;
+		sigaction(STACK_CAPTURE_SIGNAL,&action,nullptr);
+	}
+
+	QStringList CaptureStack(std::chrono::milliseconds timeout)
+	{
+		stackFrameCount.store(-1,std::memory_order_relaxed);
+		if (pthread_kill(guiThread,STACK_CAPTURE_SIGNAL) != 0) return {};
+
+		const std::chrono::steady_clock::time_point deadline=std::chrono::steady_clock::now()+timeout;
+		int count=-1;
+		while ((count=stackFrameCount.load(std::memory_order_acquire)) < 0)
+		{
+			if (std::chrono::steady_clock::now() > deadline) return {};
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		QStringList frames;
+		if (char **symbols=backtrace_symbols(stackFrames,count); symbols)
+		{
+			for (int index=2; index < count; index++) frames.append(QString::fromLocal8Bit(symbols[index])); // skip the handler and the signal trampoline
+			free(symbols);
+		}
+		return frames;
+	}
+}
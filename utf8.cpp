@@ -0,0 +1,371 @@
+#include <cstdint>
+#include <cstring>
+#include <bit>
+#include "utf8.h"
+#include "metrics.h"
+#include "globals.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CELESTE_UTF8_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CELESTE_TARGET_AVX2
+#else
+#define CELESTE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace UTF8
+{
+	using Validator=bool(*)(const uint8_t *data,size_t size);
+
+	struct Dispatch
+	{
+		Validator validator;
+		const char *name;
+	};
+
+	// well-formed byte sequences straight out of table 3-7 of the Unicode standard
+	static bool ValidScalar(const uint8_t *data,size_t size)
+	{
+		size_t index=0;
+		while (index < size)
+		{
+			const uint8_t lead=data[index];
+			if (lead < 0x80)
+			{
+				index++;
+				continue;
+			}
+
+			size_t length=0;
+			uint8_t low=0x80;
+			uint8_t high=0xBF;
+			if (lead >= 0xC2 && lead <= 0xDF)
+			{
+				length=2;
+			}
+			else if (lead >= 0xE0 && lead <= 0xEF)
+			{
+				length=3;
+				if (lead == 0xE0) low=0xA0; // overlong
+				if (lead == 0xED) high=0x9F; // surrogates
+			}
+			else if (lead >= 0xF0 && lead <= 0xF4)
+			{
+				length=4;
+				if (lead == 0xF0) low=0x90; // overlong
+				if (lead == 0xF4) high=0x8F; // past U+10FFFF
+			}
+			else
+			{
+				return false;
+			}
+
+			if (size-index < length || data[index+1] < low || data[index+1] > high) return false;
+			for (size_t continuation=2; continuation < length; continuation++)
+			{
+				if ((data[index+continuation] & 0xC0) != 0x80) return false;
+			}
+			index+=length;
+		}
+		return true;
+	}
+
+#ifdef CELESTE_UTF8_X86
+	// Keiser and Lemire's lookup algorithm ("Validating UTF-8 In Less Than One Instruction Per Byte"): three table
+	// lookups, on the high and low nibbles of each byte and the high nibble of the byte after it, flag every error
+	// that fits in two bytes, and a saturating subtract finds where the third and fourth bytes of a sequence must be
+	namespace AVX2
+	{
+		const uint8_t TOO_SHORT=1 << 0;
+		const uint8_t TOO_LONG=1 << 1;
+		const uint8_t OVERLONG_3=1 << 2;
+		const uint8_t TOO_LARGE=1 << 3;
+		const uint8_t SURROGATE=1 << 4;
+		const uint8_t OVERLONG_2=1 << 5;
+		const uint8_t TOO_LARGE_1000=1 << 6;
+		const uint8_t OVERLONG_4=1 << 6;
+		const uint8_t TWO_CONTINUATIONS=1 << 7;
+		const uint8_t CARRY=TOO_SHORT|TOO_LONG|TWO_CONTINUATIONS;
+
+		alignas(16) const uint8_t FIRST_HIGH_NIBBLE[16]={
+			TOO_LONG,TOO_LONG,TOO_LONG,TOO_LONG,TOO_LONG,TOO_LONG,TOO_LONG,TOO_LONG, // ASCII
+			TWO_CONTINUATIONS,TWO_CONTINUATIONS,TWO_CONTINUATIONS,TWO_CONTINUATIONS, // continuation
+			TOO_SHORT|OVERLONG_2, // 1100____
+			TOO_SHORT, // 1101____
+			TOO_SHORT|OVERLONG_3|SURROGATE, // 1110____
+			TOO_SHORT|TOO_LARGE|TOO_LARGE_1000|OVERLONG_4 // 1111____
+		};
+
+		alignas(16) const uint8_t FIRST_LOW_NIBBLE[16]={
+			CARRY|OVERLONG_3|OVERLONG_2|OVERLONG_4, // ____0000
+			CARRY|OVERLONG_2, // ____0001
+			CARRY,
+			CARRY,
+			CARRY|TOO_LARGE, // ____0100
+			CARRY|TOO_LARGE|TOO_LARGE_1000,
+			CARRY|TOO_LARGE|TOO_LARGE_1000,
+			CARRY|TOO_LARGE|TOO_LARGE_1000,
+			CARRY|TOO_LARGE|TOO_LARGE_1000,
+			CARRY|TOO_LARGE|TOO_LARGE_1000,
+			CARRY|TOO_LARGE|TOO_LARGE_1000,
+			CARRY|TOO_LARGE|TOO_LARGE_1000,
+			CARRY|TOO_LARGE|TOO_LARGE_1000,
+			CARRY|TOO_LARGE|TOO_LARGE_1000|SURROGATE, // ____1101
+			CARRY|TOO_LARGE|TOO_LARGE_1000,
+			CARRY|TOO_LARGE|TOO_LARGE_1000
+		};
+
+		alignas(16) const uint8_t SECOND_HIGH_NIBBLE[16]={
+			TOO_SHORT,TOO_SHORT,TOO_SHORT,TOO_SHORT,TOO_SHORT,TOO_SHORT,TOO_SHORT,TOO_SHORT, // ASCII
+			TOO_LONG|OVERLONG_2|TWO_CONTINUATIONS|OVERLONG_3|TOO_LARGE_1000|OVERLONG_4, // 1000____
+			TOO_LONG|OVERLONG_2|TWO_CONTINUATIONS|OVERLONG_3|TOO_LARGE, // 1001____
+			TOO_LONG|OVERLONG_2|TWO_CONTINUATIONS|SURROGATE|TOO_LARGE, // 101_____
+			TOO_LONG|OVERLONG_2|TWO_CONTINUATIONS|SURROGATE|TOO_LARGE,
+			TOO_SHORT,TOO_SHORT,TOO_SHORT,TOO_SHORT // lead
+		};
+
+		// a lead byte this close to the end of a block needs bytes from the next one
+		alignas(32) const uint8_t LAST_COMPLETE[32]={
+			0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+			0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xF0-1,0xE0-1,0xC0-1
+		};
+
+		struct State
+		{
+			__m256i previous;
+			__m256i incomplete;
+			__m256i error;
+		};
+
+		CELESTE_TARGET_AVX2 static __m256i Table(const uint8_t *table)
+		{
+			return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table)));
+		}
+
+		// the block shifted N bytes later, with the end of the previous block filling in at the front
+		template<int N> CELESTE_TARGET_AVX2 static __m256i Previous(__m256i input,__m256i previous)
+		{
+			return _mm256_alignr_epi8(input,_mm256_permute2x128_si256(previous,input,0x21),16-N);
+		}
+
+		CELESTE_TARGET_AVX2 static __m256i HighNibbles(__m256i input)
+		{
+			return _mm256_and_si256(_mm256_srli_epi16(input,4),_mm256_set1_epi8(0x0F));
+		}
+
+		CELESTE_TARGET_AVX2 static __m256i Errors(__m256i input,__m256i previous)
+		{
+			const __m256i previous1=Previous<1>(input,previous);
+			const __m256i special=_mm256_and_si256(
+				_mm256_and_si256(
+					_mm256_shuffle_epi8(Table(FIRST_HIGH_NIBBLE),HighNibbles(previous1)),
+					_mm256_shuffle_epi8(Table(FIRST_LOW_NIBBLE),_mm256_and_si256(previous1,_mm256_set1_epi8(0x0F)))
+				),
+				_mm256_shuffle_epi8(Table(SECOND_HIGH_NIBBLE),HighNibbles(input))
+			);
+			const __m256i third=_mm256_subs_epu8(Previous<2>(input,previous),_mm256_set1_epi8(static_cast<char>(0xE0-0x80))); // only 111_____ is left with its high bit set
+			const __m256i fourth=_mm256_subs_epu8(Previous<3>(input,previous),_mm256_set1_epi8(static_cast<char>(0xF0-0x80))); // only 1111____
+			const __m256i expected=_mm256_and_si256(_mm256_or_si256(third,fourth),_mm256_set1_epi8(static_cast<char>(0x80)));
+			return _mm256_xor_si256(expected,special);
+		}
+
+		CELESTE_TARGET_AVX2 static void Step(State &state,__m256i input)
+		{
+			if (_mm256_movemask_epi8(input) == 0)
+			{
+				state.error=_mm256_or_si256(state.error,state.incomplete); // a whole block of ASCII can't finish what the last one started
+				state.incomplete=_mm256_setzero_si256();
+			}
+			else
+			{
+				state.error=_mm256_or_si256(state.error,Errors(input,state.previous));
+				state.incomplete=_mm256_subs_epu8(input,_mm256_load_si256(reinterpret_cast<const __m256i*>(LAST_COMPLETE)));
+			}
+			state.previous=input;
+		}
+
+		CELESTE_TARGET_AVX2 static bool Valid(const uint8_t *data,size_t size)
+		{
+			State state={
+				.previous=_mm256_setzero_si256(),
+				.incomplete=_mm256_setzero_si256(),
+				.error=_mm256_setzero_si256()
+			};
+			size_t index=0;
+			for (; index+32 <= size; index+=32) Step(state,_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data+index)));
+			if (index < size)
+			{
+				alignas(32) uint8_t tail[32]={}; // padded with NUL, which is ASCII, so it can't hide an error or cause one
+				std::memcpy(tail,data+index,size-index);
+				Step(state,_mm256_load_si256(reinterpret_cast<const __m256i*>(tail)));
+			}
+			const __m256i error=_mm256_or_si256(state.error,state.incomplete);
+			return _mm256_testz_si256(error,error);
+		}
+	}
+
+	static bool SupportsAVX2()
+	{
+#ifdef _MSC_VER
+		int registers[4];
+		__cpuid(registers,0);
+		if (registers[0] < 7) return false;
+		__cpuid(registers,1);
+		const bool osxsave=(registers[2] & (1 << 27)) != 0;
+		const bool avx=(registers[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false; // the OS has to save the YMM registers too
+		__cpuidex(registers,7,0);
+		return (registers[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	static const Dispatch& Selected()
+	{
+		static const Dispatch selected=[]() -> Dispatch {
+#ifdef CELESTE_UTF8_X86
+			if (SupportsAVX2()) return {.validator=AVX2::Valid,.name="avx2"};
+#endif
+			return {.validator=ValidScalar,.name="scalar"};
+		}();
+		return selected;
+	}
+
+	bool Valid(QByteArrayView bytes)
+	{
+		return Selected().validator(reinterpret_cast<const uint8_t*>(bytes.data()),static_cast<size_t>(bytes.size()));
+	}
+
+	const char* Kernel()
+	{
+		return Selected().name;
+	}
+
+	// once the bytes are known to be good, decoding doesn't have to check anything, and runs of ASCII are widened
+	// 16 at a time (SSE2 is always there on x86-64)
+	QString Decode(QByteArrayView bytes)
+	{
+		static Metrics::Counter &invalid=Metrics::FindCounter(u"celeste_utf8_invalid_total"_s,u"Inbound messages that weren't valid UTF-8"_s);
+
+		if (!Valid(bytes))
+		{
+			invalid.Increment();
+			return QString::fromUtf8(bytes);
+		}
+
+		const uint8_t *data=reinterpret_cast<const uint8_t*>(bytes.data());
+		const size_t size=static_cast<size_t>(bytes.size());
+		QString result(bytes.size(),Qt::Uninitialized); // valid UTF-8 never needs more UTF-16 code units than it has bytes
+		char16_t *output=reinterpret_cast<char16_t*>(result.data());
+		char16_t *cursor=output;
+		size_t index=0;
+		while (index < size)
+		{
+#ifdef CELESTE_UTF8_X86
+			if (size-index >= 16)
+			{
+				const __m128i chunk=_mm_loadu_si128(reinterpret_cast<const __m128i*>(data+index));
+				const unsigned int mask=static_cast<unsigned int>(_mm_movemask_epi8(chunk));
+				if (mask == 0)
+				{
+					const __m128i zero=_mm_setzero_si128();
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(cursor),_mm_unpacklo_epi8(chunk,zero));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(cursor+8),_mm_unpackhi_epi8(chunk,zero));
+					index+=16;
+					cursor+=16;
+					continue;
+				}
+				for (const size_t end=index+static_cast<size_t>(std::countr_zero(mask)); index < end; index++) *cursor++=data[index];
+			}
+#endif
+			const uint8_t lead=data[index];
+			if (lead < 0x80)
+			{
+				*cursor++=lead;
+				index++;
+			}
+			else if (lead < 0xE0)
+			{
+				*cursor++=static_cast<char16_t>(((lead & 0x1F) << 6)|(data[index+1] & 0x3F));
+				index+=2;
+			}
+			else if (lead < 0xF0)
+			{
+				*cursor++=static_cast<char16_t>(((lead & 0x0F) << 12)|((data[index+1] & 0x3F) << 6)|(data[index+2] & 0x3F));
+				index+=3;
+			}
+			else
+			{
+				const uint32_t codepoint=(((lead & 0x07) << 18)|((data[index+1] & 0x3F) << 12)|((data[index+2] & 0x3F) << 6)|(data[index+3] & 0x3F))-0x10000;
+				*cursor++=static_cast<char16_t>(0xD800+(codepoint >> 10));
+				*cursor++=static_cast<char16_t>(0xDC00+(codepoint & 0x3FF));
+				index+=4;
+			}
+		}
+		result.truncate(cursor-output);
+		return result;
+	}
+}
+
+namespace UTF16
+{
+	static bool HighSurrogate(char16_t unit)
+	{
+		return (unit & 0xFC00) == 0xD800;
+	}
+
+	static bool LowSurrogate(char16_t unit)
+	{
+		return (unit & 0xFC00) == 0xDC00;
+	}
+
+	// where the first high surrogate is, checking 8 code units at a time on x86-64, or the size of the text if there isn't one
+	static qsizetype FirstSurrogate(const char16_t *text,qsizetype size)
+	{
+		qsizetype index=0;
+#ifdef CELESTE_UTF8_X86
+		const __m128i mask=_mm_set1_epi16(static_cast<short>(0xFC00));
+		const __m128i high=_mm_set1_epi16(static_cast<short>(0xD800));
+		for (; index+8 <= size; index+=8)
+		{
+			const __m128i chunk=_mm_loadu_si128(reinterpret_cast<const __m128i*>(text+index));
+			const unsigned int found=static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(chunk,mask),high)));
+			if (found) return index+std::countr_zero(found)/2; // two mask bits for every code unit
+		}
+#endif
+		for (; index < size; index++)
+		{
+			if (HighSurrogate(text[index])) return index;
+		}
+		return size;
+	}
+
+	CodepointMap::CodepointMap(QStringView text) : units(text.size()), codepoints(text.size())
+	{
+		const char16_t *data=text.utf16();
+		const qsizetype first=FirstSurrogate(data,units);
+		if (first == units) return;
+
+		offsets.reserve(static_cast<size_t>(units));
+		for (qsizetype index=0; index < first; index++) offsets.push_back(static_cast<quint32>(index));
+		for (qsizetype index=first; index < units; index++)
+		{
+			offsets.push_back(static_cast<quint32>(index));
+			if (HighSurrogate(data[index]) && index+1 < units && LowSurrogate(data[index+1])) index++; // a lone surrogate counts as a codepoint of its own
+		}
+		codepoints=static_cast<qsizetype>(offsets.size());
+	}
+
+	qsizetype CodepointMap::Index(qsizetype codepoint) const
+	{
+		if (codepoint < 0) return 0;
+		if (codepoint >= codepoints) return units;
+		return offsets.empty() ? codepoint : static_cast<qsizetype>(offsets[static_cast<size_t>(codepoint)]);
+	}
+}
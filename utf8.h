@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QString>
+#include <QByteArrayView>
+#include <QStringView>
+#include <vector>
+
+// everything that comes in off a socket is UTF-8, and gets checked and turned into UTF-16 here, once; the checking
+// runs 32 bytes at a time on CPUs with AVX2 (picked when the program starts) and a byte at a time everywhere else
+namespace UTF8
+{
+	bool Valid(QByteArrayView bytes);
+	QString Decode(QByteArrayView bytes); // invalid sequences become U+FFFD, the same as QString::fromUtf8
+	const char* Kernel(); // which validator this CPU ended up with
+}
+
+namespace UTF16
+{
+	// Twitch gives positions in a message (like where its emotes are) in codepoints, but a QString is indexed in
+	// UTF-16 code units, and the two stop agreeing at the first emoji; one pass over the message builds a table
+	// that answers any position after that without walking the text again
+	class CodepointMap
+	{
+	public:
+		CodepointMap(QStringView text);
+		qsizetype Codepoints() const { return codepoints; }
+		qsizetype Index(qsizetype codepoint) const; // where the codepoint starts in the text, or the end of the text if it's past it
+	protected:
+		qsizetype units;
+		qsizetype codepoints;
+		std::vector<quint32> offsets; // left empty when every codepoint is a single code unit, which is most chat
+	};
+}
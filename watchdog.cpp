@@ -0,0 +1,159 @@
+#include <QCoreApplication>
+#include <QEvent>
+#include <QMetaEnum>
+#include "watchdog.h"
+#include "metrics.h"
+#include "trace.h"
+#include "globals.h"
+
+const QString Watchdog::SETTINGS_CATEGORY="Watchdog";
+
+Watchdog::Watchdog(QObject *parent) : QObject(parent),
+	running(false),
+	beatInterval(0),
+	stallThreshold(0),
+	lastBeat(0),
+	activityClass(nullptr),
+	activityEvent(QEvent::None),
+	suppressed(0),
+	settingEnabled(SETTINGS_CATEGORY,"Enabled",true),
+	settingInterval(SETTINGS_CATEGORY,"Interval",100), // in milliseconds
+	settingThreshold(SETTINGS_CATEGORY,"Threshold",250), // in milliseconds
+	settingReportInterval(SETTINGS_CATEGORY,"ReportInterval",30) // in seconds
+{
+	heartbeat.setTimerType(Qt::PreciseTimer);
+	connect(&heartbeat,&QTimer::timeout,this,&Watchdog::Beat);
+}
+
+Watchdog::~Watchdog()
+{
+	Stop();
+}
+
+void Watchdog::Start()
+{
+	static const char *OPERATION="start";
+
+	if (!settingEnabled || running) return;
+	beatInterval=settingInterval;
+	stallThreshold=settingThreshold;
+	if (beatInterval.count() < 1 || stallThreshold <= beatInterval)
+	{
+		emit Print(u"Stall threshold must be longer than the heartbeat interval"_s,OPERATION);
+		return;
+	}
+
+	Platform::PrepareStackCapture();
+	QCoreApplication::instance()->installEventFilter(this);
+	lastBeat.store(Now(),std::memory_order_relaxed);
+	lastReport=Clock::time_point();
+	running=true;
+	monitor=std::thread(&Watchdog::Monitor,this);
+	heartbeat.start(beatInterval);
+	emit Print(u"Watching the event loop for stalls longer than %1 ms"_s.arg(StringConvert::PositiveInteger(static_cast<unsigned int>(stallThreshold.count()))),OPERATION);
+}
+
+void Watchdog::Stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (!running) return;
+		running=false;
+	}
+	wake.notify_all();
+	monitor.join();
+	heartbeat.stop();
+	QCoreApplication::instance()->removeEventFilter(this);
+}
+
+void Watchdog::Beat()
+{
+	static Metrics::Histogram &lag=Metrics::FindHistogram(u"celeste_event_loop_lag_seconds"_s,u"How late each watchdog heartbeat reached the event loop"_s);
+	static Metrics::Histogram &stallTime=Metrics::FindHistogram(u"celeste_event_loop_stall_seconds"_s,u"How long the event loop was blocked, for each stall over the watchdog threshold"_s);
+	static Metrics::Counter &stalls=Metrics::FindCounter(u"celeste_event_loop_stalls_total"_s,u"Number of times the event loop was blocked for longer than the watchdog threshold"_s);
+
+	const qint64 now=Now();
+	const qint64 previous=lastBeat.exchange(now,std::memory_order_relaxed);
+	const std::chrono::microseconds late=std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds(now-previous)-beatInterval);
+	lag.Record(late);
+	if (late < stallThreshold) return;
+
+	stalls.Increment();
+	stallTime.Record(late);
+	Trace::Complete("watchdog","stall",Clock::time_point(std::chrono::nanoseconds(previous)));
+
+	// the monitor only captures once per stall, keyed by the beat the loop was stuck after
+	std::optional<Capture> captured;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (capture && capture->beat == previous) captured=std::move(capture);
+		capture.reset();
+	}
+
+	const Clock::time_point reported=Clock::now();
+	if (reported-lastReport < static_cast<std::chrono::seconds>(settingReportInterval))
+	{
+		suppressed++;
+		return;
+	}
+	lastReport=reported;
+
+	QString message=u"Event loop stalled for %1 ms"_s.arg(StringConvert::PositiveInteger(static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::milliseconds>(late).count())));
+	if (captured && !captured->activity.isEmpty()) message.append(u" while handling %1"_s.arg(captured->activity));
+	if (suppressed > 0) message.append(u" (%1 more since the last report)"_s.arg(StringConvert::PositiveInteger(suppressed)));
+	if (captured && !captured->stack.isEmpty()) message.append(u"\n\t"_s+captured->stack.join(u"\n\t"_s));
+	suppressed=0;
+	emit Print(message,u"stall"_s);
+}
+
+void Watchdog::Monitor()
+{
+	const qint64 threshold=std::chrono::duration_cast<std::chrono::nanoseconds>(stallThreshold).count();
+	std::unique_lock<std::mutex> guard(lock);
+	while (running)
+	{
+		wake.wait_for(guard,beatInterval);
+		if (!running) break;
+
+		const qint64 beat=lastBeat.load(std::memory_order_relaxed);
+		if (Now()-beat < threshold || (capture && capture->beat == beat)) continue;
+
+		// grab the stack while the loop is still stuck, since by the time the late beat arrives it's too late
+		guard.unlock();
+		Capture stuck{
+			.beat=beat,
+			.stack=Platform::CaptureStack(beatInterval),
+			.activity=QString()
+		};
+		if (const char *className=activityClass.load(std::memory_order_relaxed); className)
+		{
+			const char *eventName=QMetaEnum::fromType<QEvent::Type>().valueToKey(activityEvent.load(std::memory_order_relaxed));
+			stuck.activity=u"%1 (%2)"_s.arg(QString::fromLatin1(className),eventName ? QString::fromLatin1(eventName) : StringConvert::Integer(activityEvent.load(std::memory_order_relaxed)));
+		}
+		guard.lock();
+		capture=std::move(stuck);
+	}
+}
+
+bool Watchdog::eventFilter(QObject *object,QEvent *event)
+{
+	// application filters see every event on the GUI thread on its way to its receiver, so whatever came through last is what's running
+	activityClass.store(object->metaObject()->className(),std::memory_order_relaxed);
+	activityEvent.store(event->type(),std::memory_order_relaxed);
+	return false;
+}
+
+qint64 Watchdog::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+ApplicationSetting& Watchdog::Interval()
+{
+	return settingInterval;
+}
+
+ApplicationSetting& Watchdog::Threshold()
+{
+	return settingThreshold;
+}
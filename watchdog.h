@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QObject>
+#include <QTimer>
+#include <QStringList>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include "settings.h"
+
+// everything runs on the GUI thread, so anything slow there freezes the whole stream; a heartbeat timer on the
+// event loop measures how late each beat arrives, and a second thread grabs the GUI thread's stack while it's stuck
+class Watchdog : public QObject
+{
+	Q_OBJECT
+public:
+	Watchdog(QObject *parent=nullptr);
+	~Watchdog();
+	void Start();
+	void Stop();
+	ApplicationSetting& Interval();
+	ApplicationSetting& Threshold();
+protected:
+	using Clock=std::chrono::steady_clock;
+	struct Capture
+	{
+		qint64 beat;
+		QStringList stack;
+		QString activity;
+	};
+	QTimer heartbeat;
+	std::thread monitor;
+	std::mutex lock;
+	std::condition_variable wake;
+	bool running;
+	std::chrono::milliseconds beatInterval;
+	std::chrono::milliseconds stallThreshold;
+	std::atomic<qint64> lastBeat; // nanoseconds since the epoch of the steady clock, written only by the GUI thread
+	std::atomic<const char*> activityClass;
+	std::atomic<int> activityEvent;
+	std::optional<Capture> capture;
+	Clock::time_point lastReport;
+	unsigned int suppressed;
+	ApplicationSetting settingEnabled;
+	ApplicationSetting settingInterval;
+	ApplicationSetting settingThreshold;
+	ApplicationSetting settingReportInterval;
+	static const QString SETTINGS_CATEGORY;
+	void Monitor();
+	bool eventFilter(QObject *object,QEvent *event) override;
+	static qint64 Now();
+signals:
+	void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("watchdog"));
+protected slots:
+	void Beat();
+};
+
+namespace Platform
+{
+	void PrepareStackCapture(); // must be called from the GUI thread
+	QStringList CaptureStack(std::chrono::milliseconds timeout); // called from any other thread, returns nothing where unsupported
+}
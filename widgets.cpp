@@ -1,4 +1,5 @@
 #include <QScrollBar>
+#include <QHeaderView>
 #include <QShowEvent>
 #include <QEvent>
 #include <QJsonDocument>
@@ -11,8 +12,16 @@
 #include <QScreen>
 #include <QMessageBox>
 #include <QInputDialog>
+#include <algorithm>
 #include "globals.h"
 #include "widgets.h"
+#include "metrics.h"
+
+const size_t CHAT_SPIKE_BATCH=8; // messages in one commit before commits start spacing out
+const size_t CHAT_CALM_BATCH=2;
+const int CHAT_MAX_FRAMES_PER_COMMIT=8;
+const std::chrono::milliseconds METRICS_REFRESH_INTERVAL=std::chrono::seconds(1);
+const std::chrono::milliseconds METRICS_TITLE_INTERVAL=std::chrono::seconds(1);
 
 namespace StyleSheet
 {
@@ -38,10 +47,90 @@ void StaticTextEdit::contextMenuEvent(QContextMenuEvent *event)
 	emit ContextMenu(event);
 }
 
-PinnedTextEdit::PinnedTextEdit(QWidget *parent) : QTextEdit(parent), scrollTransition(QPropertyAnimation(verticalScrollBar(),"sliderPosition"))
+StaticListView::StaticListView(QWidget *parent) : QListView(parent) { }
+
+void StaticListView::contextMenuEvent(QContextMenuEvent *event)
+{
+	emit ContextMenu(event);
+}
+
+RingListModel::RingListModel(size_t capacity,QObject *parent) : QAbstractListModel(parent), lines(capacity), head(0), count(0) { }
+
+int RingListModel::rowCount(const QModelIndex &parent) const
+{
+	if (parent.isValid()) return 0;
+	return static_cast<int>(count);
+}
+
+QVariant RingListModel::data(const QModelIndex &index,int role) const
+{
+	if (!index.isValid() || role != Qt::DisplayRole || index.row() < 0 || static_cast<size_t>(index.row()) >= count) return QVariant();
+	return At(static_cast<size_t>(index.row()));
+}
+
+const QString& RingListModel::At(size_t row) const
+{
+	return lines[(head+row)%lines.size()];
+}
+
+// the view only hears about the rows that fell off the front and the rows added to the back, so the cost of a batch
+// depends on the size of the batch and never on how much history is being held
+void RingListModel::Append(const QStringList &batch)
+{
+	const size_t capacity=lines.size();
+	if (batch.isEmpty() || capacity == 0) return;
+
+	const size_t incoming=static_cast<size_t>(batch.size());
+	if (incoming >= capacity)
+	{
+		// everything currently held would be pushed out anyway
+		beginResetModel();
+		for (size_t index=0; index < capacity; index++) lines[index]=batch[static_cast<qsizetype>(incoming-capacity+index)];
+		head=0;
+		count=capacity;
+		endResetModel();
+		return;
+	}
+
+	if (count+incoming > capacity)
+	{
+		const size_t overflow=count+incoming-capacity;
+		beginRemoveRows(QModelIndex(),0,static_cast<int>(overflow)-1);
+		head=(head+overflow)%capacity;
+		count-=overflow;
+		endRemoveRows();
+	}
+
+	beginInsertRows(QModelIndex(),static_cast<int>(count),static_cast<int>(count+incoming)-1);
+	for (const QString &line : batch) lines[(head+count++)%capacity]=line;
+	endInsertRows();
+}
+
+void RingListModel::Capacity(size_t capacity)
+{
+	if (capacity == lines.size()) return;
+	beginResetModel();
+	const size_t kept=std::min(count,capacity);
+	std::vector<QString> resized(capacity);
+	for (size_t index=0; index < kept; index++) resized[index]=std::move(lines[(head+count-kept+index)%lines.size()]);
+	lines=std::move(resized);
+	head=0;
+	count=kept;
+	endResetModel();
+}
+
+size_t RingListModel::Capacity() const
+{
+	return lines.size();
+}
+
+PinnedTextEdit::PinnedTextEdit(QWidget *parent) : QTextEdit(parent), scrollTransition(QPropertyAnimation(verticalScrollBar(),"sliderPosition")), framesPerCommit(1), adaptive(true)
 {
 	connect(&scrollTransition,&QPropertyAnimation::finished,this,&PinnedTextEdit::Tail);
 	connect(verticalScrollBar(),&QScrollBar::rangeChanged,this,&PinnedTextEdit::Scroll);
+	commitClock.setSingleShot(true);
+	commitClock.setTimerType(Qt::PreciseTimer);
+	connect(&commitClock,&QTimer::timeout,this,&PinnedTextEdit::Flush);
 }
 
 void PinnedTextEdit::resizeEvent(QResizeEvent *event)
@@ -58,6 +147,14 @@ void PinnedTextEdit::contextMenuEvent(QContextMenuEvent *event)
 void PinnedTextEdit::Scroll(int minimum,int maximum)
 {
 	Q_UNUSED(minimum)
+	if (framesPerCommit > 1)
+	{
+		// while commits are spaced out the animation could never catch up anyway, so go straight to the bottom
+		scrollTransition.stop();
+		scrollTransition.setEndValue(maximum);
+		verticalScrollBar()->setValue(maximum);
+		return;
+	}
 	scrollTransition.setDuration((maximum-verticalScrollBar()->value())*10); // distance remaining * ms/step (10ms/1step)
 	scrollTransition.setStartValue(verticalScrollBar()->value());
 	scrollTransition.setEndValue(maximum);
@@ -70,11 +167,52 @@ void PinnedTextEdit::Tail()
 }
 
 
-void PinnedTextEdit::Append(const QString &text)
+// messages are held until the next frame and committed together, so a burst of chat costs one relayout and one scroll per frame
+void PinnedTextEdit::Append(const QString &html)
+{
+	Append([html](QTextCursor &cursor) {
+		cursor.insertHtml(html);
+	});
+}
+
+// a fragment writes straight into the document at the cursor, which skips the HTML parser entirely
+void PinnedTextEdit::Append(Fragment fragment)
 {
+	pending.push_back(std::move(fragment));
+	if (!commitClock.isActive()) commitClock.start(UI::FrameInterval(this)*framesPerCommit);
+}
+
+void PinnedTextEdit::Flush()
+{
+	commitClock.stop();
+	if (pending.empty()) return;
+
 	Tail();
-	if (!toPlainText().isEmpty()) insertPlainText("\n"); // FIXME: this is really inefficient
-	insertHtml(text);
+	QTextCursor cursor(document());
+	cursor.movePosition(QTextCursor::End);
+	cursor.beginEditBlock();
+	for (const Fragment &fragment : pending)
+	{
+		if (!document()->isEmpty()) cursor.insertBlock();
+		fragment(cursor);
+	}
+	cursor.endEditBlock();
+
+	// in a spike, wait more frames between commits and stop animating the scroll; ease back once chat calms down
+	if (adaptive)
+	{
+		if (pending.size() >= CHAT_SPIKE_BATCH && framesPerCommit < CHAT_MAX_FRAMES_PER_COMMIT)
+			framesPerCommit*=2;
+		else if (pending.size() <= CHAT_CALM_BATCH && framesPerCommit > 1)
+			framesPerCommit/=2;
+	}
+	pending.clear();
+}
+
+void PinnedTextEdit::Adaptive(bool adaptive)
+{
+	this->adaptive=adaptive;
+	if (!adaptive) framesPerCommit=1;
 }
 
 const int ScrollingTextEdit::PAUSE=5000;
@@ -118,6 +256,13 @@ void ScrollingTextEdit::hideEvent(QHideEvent *event)
 
 namespace UI
 {
+	// how long one frame lasts on whatever screen the widget is on, assuming 60Hz when that can't be told
+	std::chrono::milliseconds FrameInterval(const QWidget *widget)
+	{
+		const qreal rate=widget->screen() ? widget->screen()->refreshRate() : 0;
+		return std::chrono::milliseconds(qRound(1000.0/(rate > 0 ? rate : 60.0)));
+	}
+
 	int ScreenWidthThird(QWidget *widget)
 	{
 		return widget->window()->windowHandle()->screen()->availableGeometry().width()/3;
@@ -1921,41 +2066,198 @@ namespace UI
 
 	namespace Metrics
 	{
+		Chatters::Chatters(QObject *parent) : QAbstractListModel(parent) { }
+
+		int Chatters::rowCount(const QModelIndex &parent) const
+		{
+			if (parent.isValid()) return 0;
+			return static_cast<int>(names.size());
+		}
+
+		QVariant Chatters::data(const QModelIndex &index,int role) const
+		{
+			if (!index.isValid() || index.row() < 0 || static_cast<size_t>(index.row()) >= names.size()) return QVariant();
+			const QString &name=names[index.row()];
+			switch (role)
+			{
+			case Qt::DisplayRole:
+				return name;
+			case Qt::ForegroundRole:
+				return acknowledged.at(name) ? acknowledgedBrush : pendingBrush;
+			default:
+				return QVariant();
+			}
+		}
+
+		void Chatters::Colors(const QBrush &pending,const QBrush &acknowledged)
+		{
+			pendingBrush=pending;
+			acknowledgedBrush=acknowledged;
+			if (!names.empty()) emit dataChanged(index(0),index(static_cast<int>(names.size())-1),{Qt::ForegroundRole});
+		}
+
+		int Chatters::Row(const QString &user) const
+		{
+			auto candidate=std::lower_bound(names.begin(),names.end(),user);
+			if (candidate == names.end() || *candidate != user) return -1;
+			return static_cast<int>(std::distance(names.begin(),candidate));
+		}
+
+		// a single join slots into place; a whole list (like the NAMES reply) is sorted on its own and merged in one pass
+		void Chatters::Add(const QStringList &users)
+		{
+			std::vector<QString> arrivals;
+			for (const QString &user : users)
+			{
+				if (acknowledged.try_emplace(user,early.remove(user)).second) arrivals.push_back(user);
+			}
+			if (arrivals.empty()) return;
+
+			if (arrivals.size() == 1)
+			{
+				auto position=std::lower_bound(names.begin(),names.end(),arrivals.front());
+				const int row=static_cast<int>(std::distance(names.begin(),position));
+				beginInsertRows(QModelIndex(),row,row);
+				names.insert(position,std::move(arrivals.front()));
+				endInsertRows();
+				return;
+			}
+
+			std::sort(arrivals.begin(),arrivals.end());
+			beginResetModel();
+			const size_t middle=names.size();
+			names.insert(names.end(),std::make_move_iterator(arrivals.begin()),std::make_move_iterator(arrivals.end()));
+			std::inplace_merge(names.begin(),names.begin()+static_cast<std::ptrdiff_t>(middle),names.end());
+			endResetModel();
+		}
+
+		void Chatters::Remove(const QStringList &users)
+		{
+			std::vector<QString> departures;
+			for (const QString &user : users)
+			{
+				early.remove(user);
+				if (acknowledged.erase(user)) departures.push_back(user);
+			}
+			if (departures.empty()) return;
+
+			if (departures.size() == 1)
+			{
+				const int row=Row(departures.front());
+				beginRemoveRows(QModelIndex(),row,row);
+				names.erase(names.begin()+row);
+				endRemoveRows();
+				return;
+			}
+
+			beginResetModel();
+			std::erase_if(names,[this](const QString &name) {
+				return !acknowledged.contains(name);
+			});
+			endResetModel();
+		}
+
+		void Chatters::Acknowledge(const QString &user)
+		{
+			auto candidate=acknowledged.find(user);
+			if (candidate == acknowledged.end())
+			{
+				early.insert(user);
+				return;
+			}
+			if (candidate->second) return;
+			candidate->second=true;
+			const QModelIndex changed=index(Row(user));
+			emit dataChanged(changed,changed,{Qt::ForegroundRole});
+		}
+
+		const int Dialog::COLUMN_COUNT=3;
+
 		Dialog::Dialog(QWidget *parent) : QDialog(parent,Qt::Dialog|Qt::CustomizeWindowHint|Qt::WindowTitleHint|Qt::WindowCloseButtonHint),
 			layout(this),
-			users(this)
-		{
-			layout.addWidget(&users);
+			chatters(this),
+			users(this),
+			readings(0,COLUMN_COUNT,this)
+		{
+			chatters.Colors(palette().mid(),palette().text());
+			users.setModel(&chatters);
+			users.setUniformItemSizes(true);
+			users.setEditTriggers(QAbstractItemView::NoEditTriggers);
+			readings.setHorizontalHeaderLabels({"Metric","Labels","Value"});
+			readings.setEditTriggers(QAbstractItemView::NoEditTriggers);
+			readings.setSelectionBehavior(QAbstractItemView::SelectRows);
+			readings.verticalHeader()->hide();
+			readings.horizontalHeader()->setStretchLastSection(true);
+			layout.addWidget(&users,1);
+			layout.addWidget(&readings,3);
 			setModal(false);
 			setSizeGripEnabled(true);
+
+			// the registry is only read while someone is looking at it
+			refreshClock.setInterval(TimeConvert::Interval(METRICS_REFRESH_INTERVAL));
+			connect(&refreshClock,&QTimer::timeout,this,&Dialog::Refresh);
+
+			// the count in the title is only redone once a second, no matter how many people come and go in between
+			titleClock.setSingleShot(true);
+			titleClock.setInterval(TimeConvert::Interval(METRICS_TITLE_INTERVAL));
+			connect(&titleClock,&QTimer::timeout,this,&Dialog::UpdateTitle);
+		}
+
+		void Dialog::Refresh()
+		{
+			const std::vector<::Metrics::Reading> current=::Metrics::Readings();
+			readings.setRowCount(static_cast<int>(current.size()));
+			for (int row=0; row < static_cast<int>(current.size()); row++)
+			{
+				const ::Metrics::Reading &reading=current[row];
+				const QStringList cells={reading.name,reading.labels,reading.value};
+				for (int column=0; column < COLUMN_COUNT; column++)
+				{
+					QTableWidgetItem *item=readings.item(row,column);
+					if (!item)
+					{
+						item=new QTableWidgetItem();
+						readings.setItem(row,column,item);
+					}
+					if (item->text() != cells.at(column)) item->setText(cells.at(column));
+				}
+			}
+		}
+
+		void Dialog::showEvent(QShowEvent *event)
+		{
+			Refresh();
+			readings.resizeColumnsToContents();
+			refreshClock.start();
+			QDialog::showEvent(event);
+		}
+
+		void Dialog::hideEvent(QHideEvent *event)
+		{
+			refreshClock.stop();
+			QDialog::hideEvent(event);
 		}
 
-		void Dialog::Joined(const QString &user)
+		void Dialog::Joined(const QStringList &users)
 		{
-			QListWidgetItem *item=new QListWidgetItem(user);
-			users.addItem(item);
-			item->setForeground(palette().mid());
-			UpdateTitle();
+			chatters.Add(users);
+			if (!titleClock.isActive()) titleClock.start();
 		}
 
 		void Dialog::Acknowledged(const QString &name)
 		{
-			QList<QListWidgetItem*> items=users.findItems(name,Qt::MatchExactly);
-			if (items.isEmpty()) return;
-			QListWidgetItem *item=items.at(0);
-			item->setForeground(palette().text());
+			chatters.Acknowledge(name);
 		}
 
-		void Dialog::Parted(const QString &user)
+		void Dialog::Parted(const QStringList &users)
 		{
-			QList<QListWidgetItem*> items=users.findItems(user,Qt::MatchExactly);
-			for (QListWidgetItem *item : items) delete users.takeItem(users.row(item));
-			UpdateTitle();
+			chatters.Remove(users);
+			if (!titleClock.isActive()) titleClock.start();
 		}
 
 		void Dialog::UpdateTitle()
 		{
-			setWindowTitle(QStringLiteral("Metrics (%1)").arg(StringConvert::Integer(users.count())));
+			setWindowTitle(QStringLiteral("Metrics (%1)").arg(StringConvert::Integer(chatters.rowCount())));
 		}
 	}
 
@@ -1,10 +1,13 @@
 #pragma once
 
 #include <QTextEdit>
+#include <QTextCursor>
 #include <QTimer>
 #include <QPropertyAnimation>
 #include <QLineEdit>
 #include <QListWidget>
+#include <QListView>
+#include <QAbstractListModel>
 #include <QTableWidget>
 #include <QCheckBox>
 #include <QComboBox>
@@ -52,14 +55,51 @@ signals:
 	void ContextMenu(QContextMenuEvent *event);
 };
 
+class StaticListView : public QListView
+{
+	Q_OBJECT
+public:
+	StaticListView(QWidget *parent);
+protected:
+	void contextMenuEvent(QContextMenuEvent *event) override;
+signals:
+	void ContextMenu(QContextMenuEvent *event);
+};
+
+// holds the newest lines up to a fixed capacity, overwriting the oldest in place, so memory stays flat no matter how long it runs
+class RingListModel : public QAbstractListModel
+{
+	Q_OBJECT
+public:
+	RingListModel(size_t capacity,QObject *parent=nullptr);
+	int rowCount(const QModelIndex &parent=QModelIndex()) const override;
+	QVariant data(const QModelIndex &index,int role=Qt::DisplayRole) const override;
+	void Append(const QStringList &batch);
+	void Capacity(size_t capacity);
+	size_t Capacity() const;
+protected:
+	std::vector<QString> lines;
+	size_t head; // slot holding the oldest line
+	size_t count;
+	const QString& At(size_t row) const;
+};
+
 class PinnedTextEdit : public QTextEdit
 {
 	Q_OBJECT
 public:
+	using Fragment=std::function<void(QTextCursor &cursor)>;
 	PinnedTextEdit(QWidget *parent);
-	void Append(const QString &text);
+	void Append(const QString &html);
+	void Append(Fragment fragment);
+	void Flush();
+	void Adaptive(bool adaptive);
 protected:
 	QPropertyAnimation scrollTransition;
+	QTimer commitClock;
+	std::vector<Fragment> pending;
+	int framesPerCommit;
+	bool adaptive;
 	void resizeEvent(QResizeEvent *event) override;
 	void contextMenuEvent(QContextMenuEvent *event) override;
 signals:
@@ -85,6 +125,7 @@ signals:
 
 namespace UI
 {
+	std::chrono::milliseconds FrameInterval(const QWidget *widget);
 	void Valid(QWidget *widget,bool valid);
 	void Require(QWidget *widget,bool empty);
 	QString OpenVideo(QWidget *parent,QString initialPath=QString());
@@ -606,6 +647,27 @@ namespace UI
 
 	namespace Metrics
 	{
+		// everyone in chat, kept sorted for display with a hash on the side so finding someone never walks the list
+		class Chatters : public QAbstractListModel
+		{
+			Q_OBJECT
+		public:
+			Chatters(QObject *parent);
+			int rowCount(const QModelIndex &parent=QModelIndex()) const override;
+			QVariant data(const QModelIndex &index,int role=Qt::DisplayRole) const override;
+			void Colors(const QBrush &pending,const QBrush &acknowledged);
+			void Add(const QStringList &users);
+			void Remove(const QStringList &users);
+			void Acknowledge(const QString &user);
+		protected:
+			std::vector<QString> names;
+			std::unordered_map<QString,bool> acknowledged;
+			QSet<QString> early; // welcomed before presence reported them arriving, since arrivals are batched
+			QBrush pendingBrush;
+			QBrush acknowledgedBrush;
+			int Row(const QString &user) const;
+		};
+
 		class Dialog : public QDialog
 		{
 			Q_OBJECT
@@ -613,13 +675,22 @@ namespace UI
 			Dialog(QWidget *parent);
 		protected:
 			QHBoxLayout layout;
-			QListWidget users;
+			Chatters chatters;
+			QListView users;
+			QTableWidget readings;
+			QTimer refreshClock;
+			QTimer titleClock;
 			static const QString TITLE;
+			static const int COLUMN_COUNT;
+			void showEvent(QShowEvent *event) override;
+			void hideEvent(QHideEvent *event) override;
+		protected slots:
+			void Refresh();
 			void UpdateTitle();
 		public slots:
-			void Joined(const QString &user);
+			void Joined(const QStringList &users);
 			void Acknowledged(const QString &name);
-			void Parted(const QString &user);
+			void Parted(const QStringList &users);
 		};
 	}
 
@@ -5,6 +5,7 @@
 #undef DELETE
 
 #include "window.h"
+#include "watchdog.h"
 
 Win32Window::Win32Window() : Window()
 {
@@ -22,3 +23,17 @@ namespace Filesystem
 		return file.fileName();
 	}
 }
+
+namespace Platform
+{
+	// stalls are still timed and reported on Windows, just without a stack
+	void PrepareStackCapture()
+	{
+	}
+
+	QStringList CaptureStack(std::chrono::milliseconds timeout)
+	{
+		Q_UNUSED(timeout)
+		return {};
+	}
+}
@@ -14,8 +14,13 @@
 #include <chrono>
 #include <stdexcept>
 #include "window.h"
+#include "imaging.h"
+#include "metrics.h"
+#include "trace.h"
 
 const char *SETTINGS_CATEGORY_WINDOW="Window";
+const char *SETTINGS_CATEGORY_TRACE="Trace";
+const char *TRACE_DIRECTORY="traces";
 
 using PrintLog=QOverload<const QString&,const QString&,const QString&>;
 using PrintUI=QOverload<const QString&>;
@@ -25,14 +30,21 @@ Window::Window() : QMainWindow(nullptr),
 	livePersistentPane(nullptr),
 	settingWindowSize(SETTINGS_CATEGORY_WINDOW,"Size",ScreenThird()),
 	settingBackgroundColor(SETTINGS_CATEGORY_WINDOW,"BackgroundColor","#ff000000"),
+	settingTraceEnabled(SETTINGS_CATEGORY_TRACE,"Enabled",false),
+	settingTraceWindow(SETTINGS_CATEGORY_TRACE,"Window",120), // in seconds
 	configureOptions("Options",this),
 	configureCommands("Commands",this),
 	configureEventSubscriptions("Event Subscriptions",this),
 	metrics("Metrics",this),
-	vibePlaylist("Vibe Playlist",this)
+	vibePlaylist("Vibe Playlist",this),
+	tracing("Tracing",this),
+	saveTrace("Save Trace",this)
 {
 	setAttribute(Qt::WA_TranslucentBackground,true);
 	setFixedSize(settingWindowSize);
+	const QSize windowSize=settingWindowSize;
+	const int coverSize=std::max(windowSize.width(),windowSize.height());
+	Imaging::DisplaySize({coverSize,coverSize});
 
 	layout()->setContentsMargins(0,0,0,0);
 	background->setLayout(new QGridLayout(background)); // for translucency to work, there has to be a widget covering the window, otherwise the entire thing is clear
@@ -57,6 +69,11 @@ Window::Window() : QMainWindow(nullptr),
 	connect(&configureEventSubscriptions,&QAction::triggered,this,&Window::ConfigureEventSubscriptions);
 	connect(&metrics,&QAction::triggered,this,&Window::ShowMetrics);
 	connect(&vibePlaylist,&QAction::triggered,this,&Window::ShowVibePlaylist);
+	tracing.setCheckable(true);
+	tracing.setChecked(settingTraceEnabled);
+	Trace::Enable(settingTraceEnabled);
+	connect(&tracing,&QAction::toggled,this,&Window::ToggleTracing);
+	connect(&saveTrace,&QAction::triggered,this,&Window::SaveTrace);
 
 	StatusPane *pane=new StatusPane(this);
 	connect(pane,&StatusPane::ContextMenu,this,&Window::contextMenuEvent);
@@ -232,19 +249,7 @@ void Window::ShowPortraitVideo(const QString &path)
 
 void Window::ShowCommandList(std::vector<std::tuple<QString,QStringList,QString>> descriptions)
 {
-	QString text;
-	for (std::tuple<QString,QStringList,QString> &command : descriptions)
-	{
-		// https://doc.qt.io/qt-6/qstring.html#prepend
-		// This operation is typically very fast (constant time),
-		// because QString preallocates extra space at the beginning
-		// of the string data, so it can grow without reallocating
-		// the entire string each time.
-		text.append(QString("<div class='name'>!%1<br>").arg(std::get<0>(command)));
-		if (QStringList aliases=std::get<1>(command); !aliases.empty()) text.append(QString("<span class='aliases'>%1<br></span>").arg("!"+std::get<1>(command).join(", !")));
-		text.append(QString("<span class='description'>%1</span><br></div>").arg(std::get<2>(command)));
-	}
-	ScrollingPane *pane=new ScrollingPane(text,this);
+	ScrollingPane *pane=new ScrollingPane(descriptions,this);
 	connect(pane,&ScrollingPane::Print,this,PrintLog::of(&Window::Print));
 	StageEphemeralPane(pane);
 }
@@ -361,6 +366,8 @@ void Window::ShowCurrentSong(const QString &song,const QString &artist,const QIm
 
 void Window::StageEphemeralPane(EphemeralPane *pane)
 {
+	Trace::Span span("window","stage pane",pane->metaObject()->className());
+	if (std::shared_ptr<Trace::Correlation> correlation=Trace::Correlation::Current()) correlation->Hop("staged");
 	connect(pane,&EphemeralPane::Expired,this,&Window::ReleaseLiveEphemeralPane);
 	background->layout()->addWidget(pane);
 	if (pane->HighPriority())
@@ -395,10 +402,12 @@ void Window::StageEphemeralPane(EphemeralPane *pane)
 		}
 		lowPriorityEphemeralPanes.push(pane);
 	}
+	ReportQueueDepth();
 }
 
 void Window::ReleaseLiveEphemeralPane()
 {
+	Trace::Instant("window","release pane");
 	// determine which queue the pane came from and remove it
 	if (highPriorityEphemeralPanes.empty())
 	{
@@ -415,6 +424,7 @@ void Window::ReleaseLiveEphemeralPane()
 	{
 		highPriorityEphemeralPanes.pop();
 	}
+	ReportQueueDepth();
 
 	// check what's left and return to chat if empty
 	if (highPriorityEphemeralPanes.empty())
@@ -427,6 +437,37 @@ void Window::ReleaseLiveEphemeralPane()
 	}
 }
 
+void Window::ReportQueueDepth()
+{
+	static Metrics::Gauge &highPriority=Metrics::FindGauge(u"celeste_pane_queue_depth"_s,u"Ephemeral panes showing or waiting to be shown"_s,{{u"priority"_s,u"high"_s}});
+	static Metrics::Gauge &lowPriority=Metrics::FindGauge(u"celeste_pane_queue_depth"_s,u"Ephemeral panes showing or waiting to be shown"_s,{{u"priority"_s,u"low"_s}});
+	highPriority.Set(highPriorityEphemeralPanes.size());
+	lowPriority.Set(lowPriorityEphemeralPanes.size());
+}
+
+void Window::ToggleTracing(bool enabled)
+{
+	Trace::Enable(enabled);
+	settingTraceEnabled.Set(enabled);
+}
+
+void Window::SaveTrace()
+{
+	static const char *OPERATION="save trace";
+
+	const QString filePath=Filesystem::DataPath().filePath(u"%1/trace-%2.json"_s.arg(TRACE_DIRECTORY,QDateTime::currentDateTime().toString(u"yyyyMMdd-HHmmss"_s)));
+	try
+	{
+		const qsizetype count=Trace::Dump(filePath,static_cast<std::chrono::seconds>(settingTraceWindow));
+		emit Print(u"Saved %1 trace events from the last %2 seconds to %3"_s.arg(QString::number(count),StringConvert::PositiveInteger(static_cast<unsigned int>(settingTraceWindow)),filePath),OPERATION);
+	}
+
+	catch (const std::runtime_error &exception)
+	{
+		emit Print(exception.what(),OPERATION);
+	}
+}
+
 const QSize Window::ScreenThird()
 {
 	QSize screenSize=QSize(QGuiApplication::primaryScreen()->geometry().size());
@@ -452,6 +493,9 @@ void Window::contextMenuEvent(QContextMenuEvent *event)
 	menu.addAction(&configureEventSubscriptions);
 	menu.addAction(&metrics);
 	menu.addAction(&vibePlaylist);
+	menu.addSeparator();
+	menu.addAction(&tracing);
+	menu.addAction(&saveTrace);
 	menu.exec(event->globalPos());
 	event->accept();
 }
@@ -23,13 +23,20 @@ protected:
 	std::queue<EphemeralPane*> lowPriorityEphemeralPanes;
 	ApplicationSetting settingWindowSize;
 	ApplicationSetting settingBackgroundColor;
+	ApplicationSetting settingTraceEnabled;
+	ApplicationSetting settingTraceWindow;
 	QAction configureOptions;
 	QAction configureCommands;
 	QAction configureEventSubscriptions;
 	QAction metrics;
 	QAction vibePlaylist;
+	QAction tracing;
+	QAction saveTrace;
 	void SwapPersistentPane(PersistentPane *pane);
 	void ReleaseLiveEphemeralPane();
+	void ReportQueueDepth();
+	void ToggleTracing(bool enabled);
+	void SaveTrace();
 	const QSize ScreenThird();
 	void contextMenuEvent(QContextMenuEvent *event) override;
 	void closeEvent(QCloseEvent *event) override;